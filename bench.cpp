@@ -0,0 +1,520 @@
+/* Benchmarks of every public py_str::String method against a hand-written
+ * std::string / std::string_view baseline, printed as JSON.
+ *
+ *   py_string_bench [--max-size=BYTES] [--min-time=SECONDS] [--filter=METHOD]
+ *
+ * Inputs go from 8 B to 64 MB, ASCII and mixed UTF-8 text, with a low and a
+ * high density of matches for the searching methods. Methods that change
+ * the string work on a fresh copy in every iteration, for both sides.
+ *
+ * Not timed separately, because they run the same code as a timed case:
+ * operator() (slice()), lstripped() and rstripped() (stripped()),
+ * rsplit_to() (rsplit()), splitlines_view() (splitlines()), and the
+ * start_pos of count() and the count of replace(), which are optional
+ * arguments of timed calls. Every result is one JSON object with the method,
+ * the input ("encoding", "density", "bytes"), the time per call of both
+ * sides in nanoseconds, the py_string throughput and
+ * "speedup" = baseline_ns / py_string_ns. */
+#include "py_string.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace py_str;
+
+namespace {
+
+volatile std::size_t sink;
+
+struct Input {
+    std::string encoding;
+    std::string density;
+    std::string text;
+    String py_text;
+};
+
+/* Words of mixed case letters and digits with a needle every 48 bytes or
+ * once near the end. UTF-8 text has a multi-byte character in about every
+ * fourth word. */
+std::string generate(std::size_t size, bool utf8, bool dense)
+{
+    static const char* const wide[] = { "\xc3\xa9", "\xc3\x9f", "\xe4\xb8\xad", "\xf0\x9f\x98\x80" };
+    std::string text;
+    text.reserve(size + 16);
+    unsigned seed = 2024;
+    auto random = [&seed](unsigned bound) { return ((seed = seed * 1103515245 + 12345) >> 16) % bound; };
+    std::size_t next_needle = dense ? 48 : size - size / 4;
+    while (text.size() < size) {
+        if (text.size() >= next_needle) {
+            text += "needle";
+            next_needle = dense ? text.size() + 48 : Not_found;
+        }
+        auto length = 1 + random(9);
+        for (unsigned i = 0; i < length; ++i) {
+            auto c = random(36);
+            text += static_cast<char>(c < 26 ? (random(5) ? 'a' : 'A') + c : '0' + c - 26);
+        }
+        if (utf8 && random(4) == 0)
+            text += wide[random(4)];
+        text += random(12) ? ' ' : '\n';
+    }
+    text.resize(size);
+    return text;
+}
+
+struct Case {
+    const char* method;
+    std::function<std::size_t(const String&)> py_string;
+    std::function<std::size_t(const std::string&)> baseline;
+};
+
+template <typename Run, typename Text>
+double seconds_per_run(const Run& run, const Text& text, double min_time)
+{
+    using Clock = std::chrono::steady_clock;
+    auto best = 1e300;
+    for (int batch = 0; batch < 3; ++batch) {
+        std::size_t iterations = 1;
+        for (;;) {
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < iterations; ++i)
+                sink = sink + run(text);
+            std::chrono::duration<double> elapsed = Clock::now() - start;
+            if (elapsed.count() >= min_time / 3) {
+                best = std::min(best, elapsed.count() / static_cast<double>(iterations));
+                break;
+            }
+            iterations *= 2;
+        }
+    }
+    return best;
+}
+
+bool all_of(std::string_view text, int (*predicate)(int))
+{
+    return !text.empty() && std::all_of(text.begin(), text.end(), [predicate](char c) { return predicate(static_cast<unsigned char>(c)) != 0; });
+}
+
+std::string std_lower(std::string text)
+{
+    for (auto& c : text)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+}
+
+std::string std_replace(std::string_view text, std::string_view from, std::string_view to)
+{
+    std::string result;
+    std::size_t pos = 0;
+    for (auto match = text.find(from); match != std::string_view::npos; match = text.find(from, pos)) {
+        result.append(text.substr(pos, match - pos)).append(to);
+        pos = match + from.size();
+    }
+    return result.append(text.substr(pos));
+}
+
+std::vector<std::string_view> std_split(std::string_view text)
+{
+    std::vector<std::string_view> tokens;
+    std::size_t pos = 0;
+    for (;;) {
+        pos = text.find_first_not_of(" \t\n\v\f\r", pos);
+        if (pos == std::string_view::npos)
+            return tokens;
+        auto end = std::min(text.find_first_of(" \t\n\v\f\r", pos), text.size());
+        tokens.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+}
+
+std::vector<std::string> std_pieces(const std::string& text)
+{
+    std::vector<std::string> pieces;
+    for (auto token : std_split(text))
+        pieces.emplace_back(token);
+    return pieces;
+}
+
+std::vector<Case> cases()
+{
+    using P = const String&;
+    using S = const std::string&;
+    return {
+        { "constructor", [](P t) { return String(t).size(); }, [](S t) { return std::string(t).size(); } },
+        { "accessors", [](P t) { return t.size() + t.len() + t.empty() + static_cast<std::size_t>(t.end() - t.begin()) + (t.c_str() != nullptr) + t.str_index(-1); },
+            [](S t) { return t.size() + t.size() + t.empty() + static_cast<std::size_t>(t.end() - t.begin()) + (t.c_str() != nullptr) + t.size() - 1; } },
+        { "operator[]", [](P t) { std::size_t sum = 0; for (int i = 0, n = static_cast<int>(t.size()); i < n; ++i) sum += static_cast<unsigned char>(t[i]); return sum; },
+            [](S t) { std::size_t sum = 0; for (std::size_t i = 0; i < t.size(); ++i) sum += static_cast<unsigned char>(t[i]); return sum; } },
+        { "copy", [](P t) { return t.copy().size(); }, [](S t) { return std::string(t).size(); } },
+        { "slice", [](P t) { return t.slice(1, -2).size(); }, [](S t) { return t.size() > 2 ? t.substr(1, t.size() - 2).size() : 0; } },
+        { "get_allocator", [](P t) { return sizeof(t.get_allocator()) + t.size(); }, [](S t) { return sizeof(t.get_allocator()) + t.size(); } },
+        { "contains", [](P t) { return t.contains("needle"); }, [](S t) { return std::string_view(t).find("needle") != std::string_view::npos; } },
+        { "count", [](P t) { return t.count("needle"); },
+            [](S t) {
+                std::size_t count = 0;
+                std::string_view view(t);
+                for (auto pos = view.find("needle"); pos != std::string_view::npos; pos = view.find("needle", pos + 6))
+                    ++count;
+                return count;
+            } },
+        { "count(Parallel)", [](P t) { return t.count("needle", Parallel()); },
+            [](S t) {
+                std::size_t count = 0;
+                std::string_view view(t);
+                for (auto pos = view.find("needle"); pos != std::string_view::npos; pos = view.find("needle", pos + 6))
+                    ++count;
+                return count;
+            } },
+        { "find(Parallel)", [](P t) { return t.find("needle", Parallel()); }, [](S t) { return std::string_view(t).find("needle"); } },
+        { "rfind(Parallel)", [](P t) { return t.rfind("needle", Parallel()); }, [](S t) { return std::string_view(t).rfind("needle"); } },
+        { "contains(Parallel)", [](P t) { return t.contains("needle", Parallel()); }, [](S t) { return std::string_view(t).find("needle") != std::string_view::npos; } },
+        { "startswith", [](P t) { return t.startswith("abc"); }, [](S t) { return std::string_view(t).substr(0, 3) == "abc"; } },
+        { "endswith", [](P t) { return t.endswith("xyz"); }, [](S t) { return t.size() >= 3 && std::string_view(t).substr(t.size() - 3) == "xyz"; } },
+        { "find", [](P t) { return t.find("needle"); }, [](S t) { return std::string_view(t).find("needle"); } },
+        { "index", [](P t) { return t.index("needle"); }, [](S t) { return std::string_view(t).find("needle"); } },
+        { "rfind", [](P t) { return t.rfind("needle"); }, [](S t) { return std::string_view(t).rfind("needle"); } },
+        { "rindex", [](P t) { return t.rindex("needle"); }, [](S t) { return std::string_view(t).rfind("needle"); } },
+        { "isalnum", [](P t) { return t.isalnum(); }, [](S t) { return all_of(t, std::isalnum); } },
+        { "isalpha", [](P t) { return t.isalpha(); }, [](S t) { return all_of(t, std::isalpha); } },
+        { "isdigit", [](P t) { return t.isdigit(); }, [](S t) { return all_of(t, std::isdigit); } },
+        { "isspace", [](P t) { return t.isspace(); }, [](S t) { return all_of(t, std::isspace); } },
+        { "islower", [](P t) { return t.islower(); }, [](S t) { return std::none_of(t.begin(), t.end(), [](char c) { return std::isupper(static_cast<unsigned char>(c)); }); } },
+        { "isupper", [](P t) { return t.isupper(); }, [](S t) { return std::none_of(t.begin(), t.end(), [](char c) { return std::islower(static_cast<unsigned char>(c)); }); } },
+        { "classify", [](P t) { return static_cast<std::size_t>(t.classify()); },
+            [](S t) { return static_cast<std::size_t>(all_of(t, std::isalpha) + all_of(t, std::isdigit) + all_of(t, std::isalnum) + all_of(t, std::isspace)); } },
+        { "lower", [](P t) { return String(t).lower().size(); }, [](S t) { return std_lower(t).size(); } },
+        { "upper", [](P t) { return String(t).upper().size(); },
+            [](S t) { std::string s(t); for (auto& c : s) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c))); return s.size(); } },
+        { "swapcase", [](P t) { return String(t).swapcase().size(); },
+            [](S t) {
+                std::string s(t);
+                for (auto& c : s) {
+                    auto u = static_cast<unsigned char>(c);
+                    c = static_cast<char>(std::islower(u) ? std::toupper(u) : std::tolower(u));
+                }
+                return s.size();
+            } },
+        { "casefold", [](P t) { return String(t).casefold().size(); }, [](S t) { return std_lower(t).size(); } },
+        { "capitalize", [](P t) { return String(t).capitalize().size(); },
+            [](S t) { auto s = std_lower(t); if (!s.empty()) s[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(s[0]))); return s.size(); } },
+        { "replace", [](P t) { return String(t).replace("needle", "pin").size(); }, [](S t) { return std_replace(t, "needle", "pin").size(); } },
+        { "translate", [](P t) { static const auto table = String::maketrans("abc", "xyz", "0"); return String(t).translate(table).size(); },
+            [](S t) {
+                std::string s;
+                s.reserve(t.size());
+                for (auto c : t)
+                    if (c != '0')
+                        s += c >= 'a' && c <= 'c' ? static_cast<char>(c - 'a' + 'x') : c;
+                return s.size();
+            } },
+        { "maketrans", [](P t) { auto prefix = t.slice(0, 25); return static_cast<std::size_t>(String::maketrans(prefix, prefix).map(t.empty() ? 'a' : static_cast<unsigned char>(t[0])) != 0); },
+            [](S t) {
+                short table[256];
+                for (int i = 0; i < 256; ++i)
+                    table[i] = static_cast<short>(i);
+                for (std::size_t i = 0; i < std::min<std::size_t>(t.size(), 26); ++i)
+                    table[static_cast<unsigned char>(t[i])] = static_cast<unsigned char>(t[i]);
+                return static_cast<std::size_t>(table[t.empty() ? 'a' : static_cast<unsigned char>(t[0])] != 0);
+            } },
+        { "zfill", [](P t) { return String(t).zfill(t.size() + 16).size(); }, [](S t) { std::string s(t); s.insert(0, 16, '0'); return s.size(); } },
+        { "insert", [](P t) { String s(t); s.insert(static_cast<int>(t.size() / 2), "inserted"); return s.insert(0, 'x').size(); },
+            [](S t) { std::string s(t); s.insert(t.size() / 2, "inserted"); return s.insert(0, 1, 'x').size(); } },
+        { "del", [](P t) { String s(t); return t.empty() ? 0 : s.del(static_cast<int>(t.size() / 2)).size(); },
+            [](S t) { std::string s(t); return t.empty() ? 0 : s.erase(t.size() / 2, 1).size(); } },
+        { "lstrip", [](P t) { return String(t).lstrip(StringView("abcdefghijklmnopqrstuvwxyz ")).size(); },
+            [](S t) { std::string s(t); s.erase(0, std::min(s.find_first_not_of("abcdefghijklmnopqrstuvwxyz "), s.size())); return s.size(); } },
+        { "rstrip", [](P t) { return String(t).rstrip(StringView("abcdefghijklmnopqrstuvwxyz ")).size(); },
+            [](S t) { std::string s(t); auto pos = s.find_last_not_of("abcdefghijklmnopqrstuvwxyz "); s.erase(pos == std::string::npos ? 0 : pos + 1); return s.size(); } },
+        { "strip", [](P t) { return String(t).strip().size(); },
+            [](S t) {
+                std::string s(t);
+                auto last = s.find_last_not_of(' ');
+                s.erase(last == std::string::npos ? 0 : last + 1);
+                s.erase(0, std::min(s.find_first_not_of(' '), s.size()));
+                return s.size();
+            } },
+        { "stripped", [](P t) { return t.stripped().size(); },
+            [](S t) {
+                std::string_view s(t);
+                auto last = s.find_last_not_of(' ');
+                s = s.substr(0, last == std::string_view::npos ? 0 : last + 1);
+                return s.substr(std::min(s.find_first_not_of(' '), s.size())).size();
+            } },
+        { "operator+=", [](P t) { String s; for (auto c : t) s += c; return (s += StringView(t)).size(); },
+            [](S t) { std::string s; for (auto c : t) s += c; return (s += t).size(); } },
+        { "operator+", [](P t) { String r = t + ' ' + t + ' ' + t; return r.size(); },
+            [](S t) { std::string r = t + ' ' + t + ' ' + t; return r.size(); } },
+        { "join(characters)", [](P t) { return String(",").join(String(t)).size(); },
+            [](S t) {
+                std::string s;
+                for (std::size_t i = 0; i < t.size(); ++i)
+                    (i ? s += ',' : s) += t[i];
+                return s.size();
+            } },
+        { "join", [](P t) { static thread_local std::vector<std::string> pieces; pieces = std_pieces(t.str); return String(", ").join(pieces).size(); },
+            [](S t) {
+                static thread_local std::vector<std::string> pieces;
+                pieces = std_pieces(t);
+                std::string s;
+                for (std::size_t i = 0; i < pieces.size(); ++i)
+                    (i ? s += ", " : s) += pieces[i];
+                return s.size();
+            } },
+        { "join(Parallel)", [](P t) { static thread_local std::vector<std::string> pieces; pieces = std_pieces(t.str); return String(", ").join(pieces, Parallel()).size(); },
+            [](S t) {
+                static thread_local std::vector<std::string> pieces;
+                pieces = std_pieces(t);
+                std::string s;
+                for (std::size_t i = 0; i < pieces.size(); ++i)
+                    (i ? s += ", " : s) += pieces[i];
+                return s.size();
+            } },
+        { "split", [](P t) { return String(t).split().size(); },
+            [](S t) { std::string s(t); std::vector<std::string> tokens; for (auto token : std_split(s)) tokens.emplace_back(token); return tokens.size(); } },
+        { "rsplit", [](P t) { return String(t).rsplit().size(); },
+            [](S t) {
+                std::string s(t);
+                std::vector<std::string> tokens;
+                for (auto end = s.size();;) {
+                    auto last = end ? s.find_last_not_of(" \t\n\v\f\r", end - 1) : std::string::npos;
+                    if (last == std::string::npos)
+                        break;
+                    auto found = s.find_last_of(" \t\n\v\f\r", last);
+                    auto start = found == std::string::npos ? 0 : found + 1;
+                    tokens.emplace_back(s, start, last + 1 - start);
+                    end = start;
+                }
+                std::reverse(tokens.begin(), tokens.end());
+                return tokens.size();
+            } },
+        { "split_view", [](P t) { std::size_t count = 0; for (auto token : t.split_view()) count += token.size(); return count; },
+            [](S t) { std::size_t count = 0; for (auto token : std_split(t)) count += token.size(); return count; } },
+        { "split_view(sep)", [](P t) { std::size_t count = 0; for (auto token : t.split_view(" ")) count += token.size(); return count; },
+            [](S t) {
+                std::size_t count = 0;
+                std::string_view view(t);
+                for (std::size_t pos = 0;;) {
+                    auto end = std::min(view.find(' ', pos), view.size());
+                    count += end - pos;
+                    if (end == view.size())
+                        return count;
+                    pos = end + 1;
+                }
+            } },
+        { "split(sep)", [](P t) { return String(t).split(" ").size(); },
+            [](S t) {
+                std::string s(t);
+                std::vector<std::string> tokens;
+                for (std::size_t pos = 0;;) {
+                    auto end = std::min(s.find(' ', pos), s.size());
+                    tokens.emplace_back(s, pos, end - pos);
+                    if (end == s.size())
+                        return tokens.size();
+                    pos = end + 1;
+                }
+            } },
+        { "rsplit(sep)", [](P t) { return String(t).rsplit(" ").size(); },
+            [](S t) {
+                std::string s(t);
+                std::vector<std::string> tokens;
+                for (auto end = s.size();;) {
+                    auto found = end ? s.rfind(' ', end - 1) : std::string::npos;
+                    auto start = found == std::string::npos ? 0 : found + 1;
+                    tokens.emplace_back(s, start, end - start);
+                    if (found == std::string::npos)
+                        break;
+                    end = found;
+                }
+                std::reverse(tokens.begin(), tokens.end());
+                return tokens.size();
+            } },
+        { "split_to(views)", [](P t) { static std::vector<StringView> views; return t.split_to(views, " ").size(); },
+            [](S t) {
+                static std::vector<std::string_view> views;
+                views.clear();
+                std::string_view view(t);
+                for (std::size_t pos = 0;;) {
+                    auto end = std::min(view.find(' ', pos), view.size());
+                    views.push_back(view.substr(pos, end - pos));
+                    if (end == view.size())
+                        return views.size();
+                    pos = end + 1;
+                }
+            } },
+        { "partition", [](P t) { return t.partition(" ").tail.size(); },
+            [](S t) {
+                std::string s(t);
+                auto found = s.find(' ');
+                return found == std::string::npos ? std::size_t(0) : s.substr(found + 1).size();
+            } },
+        { "rpartition", [](P t) { return t.rpartition(" ").head.size(); },
+            [](S t) {
+                std::string s(t);
+                auto found = s.rfind(' ');
+                return found == std::string::npos ? std::size_t(0) : s.substr(0, found).size();
+            } },
+        { "split(InternTable)", [](P t) { InternTable table; return t.split(table).size(); },
+            [](S t) {
+                std::unordered_map<std::string_view, std::uint32_t> table;
+                std::vector<std::uint32_t> ids;
+                for (auto token : std_split(t))
+                    ids.push_back(table.emplace(token, static_cast<std::uint32_t>(table.size())).first->second);
+                return ids.size();
+            } },
+        { "utf8::isvalid", [](P t) { return utf8::isvalid(t); },
+            [](S t) {
+                for (std::size_t i = 0; i < t.size();) {
+                    auto c = static_cast<unsigned char>(t[i]);
+                    std::size_t length = c < 0x80 ? 1 : c >= 0xc2 && c <= 0xdf ? 2 : c >= 0xe0 && c <= 0xef ? 3 : c >= 0xf0 && c <= 0xf4 ? 4 : 0;
+                    if (!length || i + length > t.size())
+                        return false;
+                    for (std::size_t j = 1; j < length; ++j)
+                        if ((static_cast<unsigned char>(t[i + j]) & 0xc0) != 0x80)
+                            return false;
+                    i += length;
+                }
+                return true;
+            } },
+        { "utf8::len", [](P t) { return utf8::len(t); },
+            [](S t) { return static_cast<std::size_t>(std::count_if(t.begin(), t.end(), [](char c) { return (static_cast<unsigned char>(c) & 0xc0) != 0x80; })); } },
+        { "utf8::upper", [](P t) { String s(t); return utf8::upper(s).size(); },
+            [](S t) {
+                std::string s;
+                s.reserve(t.size());
+                for (std::size_t i = 0; i < t.size();) {
+                    auto c = static_cast<unsigned char>(t[i]);
+                    if (c < 0x80 || c < 0xc2 || c > 0xdf || i + 1 == t.size()) {
+                        s += static_cast<char>(std::toupper(c));
+                        ++i;
+                        continue;
+                    }
+                    auto code_point = static_cast<wchar_t>(std::towupper(static_cast<std::wint_t>((c & 0x1f) << 6 | (t[i + 1] & 0x3f))));
+                    s += static_cast<char>(0xc0 | code_point >> 6);
+                    s += static_cast<char>(0x80 | (code_point & 0x3f));
+                    i += 2;
+                }
+                return s.size();
+            } },
+        { "splitlines", [](P t) { return String(t).splitlines().size(); },
+            [](S t) {
+                std::string s(t);
+                std::vector<std::string> lines;
+                std::string_view view(s);
+                for (std::size_t pos = 0; pos < view.size();) {
+                    auto end = std::min(view.find('\n', pos), view.size());
+                    lines.emplace_back(view.substr(pos, end - pos));
+                    pos = end + 1;
+                }
+                return lines.size();
+            } },
+    };
+}
+
+/* format() does not depend on the input, it runs once per size class */
+Case format_case()
+{
+    return { "format",
+        [](const String& t) { return py_str::format("{}: {:>8} {:.3f}", "cpu", t.size(), 3.14159).size(); },
+        [](const std::string& t) {
+            auto count = std::to_string(t.size());
+            auto load = std::to_string(3.14159);
+            load.resize(load.find('.') + 4);
+            std::string s = "cpu: ";
+            s.append(count.size() < 8 ? 8 - count.size() : 0, ' ');
+            return (s += count + " " + load).size();
+        } };
+}
+
+const char* simd()
+{
+#if defined(PY_STRING_AVX512)
+    return "avx512";
+#elif defined(PY_STRING_AVX2)
+    return "avx2";
+#elif defined(PY_STRING_SSSE3)
+    return "ssse3";
+#elif defined(PY_STRING_SSE2)
+    return "sse2";
+#else
+    return "none";
+#endif
+}
+
+void print_result(bool& first, const char* method, const Input& input, double py_string, double baseline)
+{
+    auto size = input.text.size();
+    std::printf("%s\n    {\"method\": \"%s\", \"encoding\": \"%s\", \"density\": \"%s\", \"bytes\": %zu, "
+                "\"py_string_ns\": %.2f, \"baseline_ns\": %.2f, \"py_string_mb_per_s\": %.2f, \"speedup\": %.3f}",
+        first ? "" : ",", method, input.encoding.c_str(), input.density.c_str(), size, py_string * 1e9, baseline * 1e9,
+        static_cast<double>(size) / py_string / 1e6, baseline / py_string);
+    first = false;
+    std::fflush(stdout);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t max_size = std::size_t(64) << 20;
+    double min_time = 0.1;
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        StringView arg(argv[i]);
+        if (arg.startswith("--max-size=")) {
+            max_size = std::strtoull(argv[i] + 11, nullptr, 10);
+        } else if (arg.startswith("--min-time=")) {
+            min_time = std::strtod(argv[i] + 11, nullptr);
+        } else if (arg.startswith("--filter=")) {
+            filter = argv[i] + 9;
+        } else {
+            std::fprintf(stderr, "usage: %s [--max-size=BYTES] [--min-time=SECONDS] [--filter=METHOD]\n", argv[0]);
+            return 1;
+        }
+    }
+
+#if defined(__OPTIMIZE__) || defined(NDEBUG)
+    auto optimized = "true";
+#else
+    auto optimized = "false";
+#endif
+    std::printf("{\n  \"library\": \"py_string\",\n  \"simd\": \"%s\",\n  \"optimized\": %s,\n  \"results\": [", simd(), optimized);
+
+    auto all = cases();
+    auto format = format_case();
+    auto first = true;
+    const std::size_t sizes[] = { 8, 64, 512, 4 << 10, 32 << 10, 256 << 10, 2 << 20, 16 << 20, 64 << 20 };
+    for (auto size : sizes) {
+        if (size > max_size)
+            break;
+
+        std::vector<Input> inputs;
+        for (auto utf8 : { false, true })
+            for (auto dense : { false, true }) {
+                auto text = generate(size, utf8, dense);
+                inputs.push_back({ utf8 ? "utf8" : "ascii", dense ? "high" : "low", text, String(text) });
+            }
+
+        for (auto& test : all) {
+            if (!filter.empty() && filter != test.method)
+                continue;
+            for (auto& input : inputs)
+                print_result(first, test.method, input, seconds_per_run(test.py_string, input.py_text, min_time), seconds_per_run(test.baseline, input.text, min_time));
+        }
+
+        if (filter.empty() || filter == format.method)
+            print_result(first, format.method, inputs[0], seconds_per_run(format.py_string, inputs[0].py_text, min_time), seconds_per_run(format.baseline, inputs[0].text, min_time));
+    }
+
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
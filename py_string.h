@@ -7,706 +7,6701 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#if !defined(PY_STRING_NO_SIMD)
+#    if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#        define PY_STRING_SSE2 1
+#        include <emmintrin.h>
+#    endif
+#    if defined(__SSSE3__) || defined(__AVX2__)
+#        define PY_STRING_SSSE3 1
+#        include <tmmintrin.h>
+#    endif
+#    if defined(__AVX2__)
+#        define PY_STRING_AVX2 1
+#        include <immintrin.h>
+#    endif
+#    if defined(__AVX512BW__)
+#        define PY_STRING_AVX512 1
+#    endif
+#endif
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define PY_STRING_POSIX 1
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#if defined(__cpp_consteval)
+#    define PY_STRING_CONSTEVAL consteval
+#else
+#    define PY_STRING_CONSTEVAL constexpr
+#endif
 
 namespace py_str {
 constexpr auto Not_found = std::string::npos;
 
-struct String {
+namespace detail {
+inline bool points_into(const char* ptr, const char* first, const char* last) noexcept
+{
+    return std::less_equal<const char*>()(first, ptr) && std::less<const char*>()(ptr, last);
+}
+
+inline unsigned count_trailing_zeros(std::uint32_t mask) noexcept
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline unsigned count_leading_zeros(std::uint32_t mask) noexcept
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return 31 - static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_clz(mask));
+#endif
+}
+
+/* Signed compare trick: bytes in [low, high] are moved to the bottom
+ * of the signed range, so a single compare selects them. */
+#if defined(PY_STRING_SSE2)
+inline __m128i in_range(__m128i block, char low, char high) noexcept
+{
+    auto key = _mm_add_epi8(block, _mm_set1_epi8(static_cast<char>(0x80 - low)));
+    return _mm_cmplt_epi8(key, _mm_set1_epi8(static_cast<char>(-128 + (high - low + 1))));
+}
+#endif
+
+#if defined(PY_STRING_AVX2)
+inline __m256i in_range(__m256i block, char low, char high) noexcept
+{
+    auto key = _mm256_add_epi8(block, _mm256_set1_epi8(static_cast<char>(0x80 - low)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + (high - low + 1))), key);
+}
+#endif
+
+/* Character classes for the vectorized scanners below. Each one
+ * tests a single byte and, when SIMD is available, builds a bitmask
+ * of matching bytes for a whole register. All of them are ASCII only
+ * and independent of the current locale. */
+struct Space_class {
+    /* Whitespace as understood by Python's bytes.split(): " \t\n\v\f\r" */
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        auto blank = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_or_si128(in_range(block, '\t', '\r'), blank)));
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        auto blank = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(in_range(block, '\t', '\r'), blank)));
+    }
+#endif
+};
+
+struct Digit_class {
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return c >= '0' && c <= '9';
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(in_range(block, '0', '9')));
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(in_range(block, '0', '9')));
+    }
+#endif
+};
+
+/* Setting bit 0x20 lowercases ASCII letters and maps no other byte
+ * into [a-z], so one range check covers both cases. */
+struct Alpha_class {
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(in_range(_mm_or_si128(block, _mm_set1_epi8(0x20)), 'a', 'z')));
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(in_range(_mm256_or_si256(block, _mm256_set1_epi8(0x20)), 'a', 'z')));
+    }
+#endif
+};
+
+struct Alnum_class {
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return Alpha_class {}(c) || Digit_class {}(c);
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        return Alpha_class {}.mask(block) | Digit_class {}.mask(block);
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        return Alpha_class {}.mask(block) | Digit_class {}.mask(block);
+    }
+#endif
+};
+
+struct Byte_class {
+    char value;
+
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return c == static_cast<unsigned char>(value);
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(value))));
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(value))));
+    }
+#endif
+};
+
+/* Bytes that can start a line boundary of Python's str.splitlines():
+ * \n \v \f \r, \x1c-\x1e, and the lead bytes of the UTF-8 encoded
+ * U+0085, U+2028 and U+2029 */
+struct Line_break_class {
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return (c >= '\n' && c <= '\r') || (c >= 0x1c && c <= 0x1e) || c == 0xc2 || c == 0xe2;
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        auto leads = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(0xc2))), _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(0xe2))));
+        auto controls = _mm_or_si128(in_range(block, '\n', '\r'), in_range(block, 0x1c, 0x1e));
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_or_si128(leads, controls)));
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        auto leads = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(static_cast<char>(0xc2))), _mm256_cmpeq_epi8(block, _mm256_set1_epi8(static_cast<char>(0xe2))));
+        auto controls = _mm256_or_si256(in_range(block, '\n', '\r'), in_range(block, 0x1c, 0x1e));
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(leads, controls)));
+    }
+#endif
+};
+
+/* Returns the first byte in [first, last) that is (or, with Negate,
+ * is not) a member of the class, or last. */
+template <bool Negate, typename Class>
+const char* find_class(const char* first, const char* last, Class cls) noexcept
+{
+#if defined(PY_STRING_AVX2)
+    for (; last - first >= 32; first += 32) {
+        auto mask = cls.mask(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first)));
+        if (Negate)
+            mask = ~mask;
+        if (mask)
+            return first + count_trailing_zeros(mask);
+    }
+#endif
+
+#if defined(PY_STRING_SSE2)
+    for (; last - first >= 16; first += 16) {
+        auto mask = cls.mask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)));
+        if (Negate)
+            mask = ~mask & 0xffff;
+        if (mask)
+            return first + count_trailing_zeros(mask);
+    }
+#endif
+
+    for (; first != last; ++first)
+        if (cls(static_cast<unsigned char>(*first)) != Negate)
+            return first;
+
+    return last;
+}
+
+/* Returns the last byte in [first, last) that is (or, with Negate, is
+ * not) a member of the class, or last when there is none. */
+template <bool Negate, typename Class>
+const char* rfind_class(const char* first, const char* last, Class cls) noexcept
+{
+    auto end = last;
+
+#if defined(PY_STRING_AVX2)
+    for (; end - first >= 32; end -= 32) {
+        auto mask = cls.mask(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(end - 32)));
+        if (Negate)
+            mask = ~mask;
+        if (mask)
+            return end - 1 - count_leading_zeros(mask);
+    }
+#endif
+
+#if defined(PY_STRING_SSE2)
+    for (; end - first >= 16; end -= 16) {
+        auto mask = cls.mask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(end - 16)));
+        if (Negate)
+            mask = ~mask & 0xffff;
+        if (mask)
+            return end + 15 - count_leading_zeros(mask);
+    }
+#endif
+
+    while (end != first)
+        if (cls(static_cast<unsigned char>(*--end)) != Negate)
+            return end;
+
+    return last;
+}
+
+constexpr bool is_space(unsigned char c) noexcept
+{
+    return Space_class {}(c);
+}
+
+inline const char* find_space(const char* first, const char* last) noexcept
+{
+    return find_class<false>(first, last, Space_class {});
+}
+
+inline const char* find_not_space(const char* first, const char* last) noexcept
+{
+    return find_class<true>(first, last, Space_class {});
+}
+
+inline const char* find_byte(const char* first, const char* last, char value) noexcept
+{
+    return find_class<false>(first, last, Byte_class { value });
+}
+
+inline const char* rfind_space(const char* first, const char* last) noexcept
+{
+    return rfind_class<false>(first, last, Space_class {});
+}
+
+inline const char* rfind_not_space(const char* first, const char* last) noexcept
+{
+    return rfind_class<true>(first, last, Space_class {});
+}
+
+inline const char* rfind_byte(const char* first, const char* last, char value) noexcept
+{
+    return rfind_class<false>(first, last, Byte_class { value });
+}
+
+/* Finds the first line boundary in [first, last) and sets length to
+ * its size in bytes, "\r\n" is a single boundary. Returns last when
+ * there is none. Without at_end, a boundary that may continue past
+ * last (a trailing "\r" or a partial UTF-8 sequence) is returned with
+ * a length of 0, as more input is needed to decide. */
+inline const char* find_line_break(const char* first, const char* last, bool at_end, std::size_t& length) noexcept
+{
+    for (;; ++first) {
+        first = find_class<false>(first, last, Line_break_class {});
+        if (first == last)
+            return last;
+
+        auto c = static_cast<unsigned char>(*first);
+        auto left = last - first;
+        if (c == '\r') {
+            if (left == 1 && !at_end)
+                break;
+            length = left > 1 && first[1] == '\n' ? 2 : 1;
+            return first;
+        }
+        if (c < 0x80) {
+            length = 1;
+            return first;
+        }
+
+        /* U+0085 is "\xc2\x85", U+2028 and U+2029 are "\xe2\x80\xa8" and "\xe2\x80\xa9" */
+        auto sequence = c == 0xc2 ? "\xc2\x85" : "\xe2\x80\xa8";
+        std::size_t size = c == 0xc2 ? 2 : 3;
+        auto available = std::min(static_cast<std::size_t>(left), size);
+        auto matches = std::memcmp(first + 1, sequence + 1, available - 1) == 0
+            || (c == 0xe2 && available == 3 && first[1] == '\x80' && first[2] == '\xa9');
+        if (!matches)
+            continue;
+        if (available == size) {
+            length = size;
+            return first;
+        }
+        if (!at_end)
+            break;
+    }
+
+    length = 0;
+    return first;
+}
+
+/* Returns the first occurrence of [needle, needle + size) in
+ * [first, last), or last. Candidates are the positions where both the
+ * first and the last byte of the needle match, a whole register of
+ * positions is tested at once and only those are compared in full. */
+inline const char* find_substring(const char* first, const char* last, const char* needle, std::size_t size) noexcept
+{
+    if (size == 0)
+        return first;
+    if (static_cast<std::size_t>(last - first) < size)
+        return last;
+    if (size == 1)
+        return find_byte(first, last, *needle);
+
+    auto stop = last - size + 1;
+    auto matches_at = [needle, size](const char* pos) { return std::memcmp(pos + 1, needle + 1, size - 2) == 0; };
+
+#if defined(PY_STRING_AVX2)
+    auto head32 = _mm256_set1_epi8(needle[0]);
+    auto tail32 = _mm256_set1_epi8(needle[size - 1]);
+    for (; stop - first >= 32; first += 32) {
+        auto heads = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first)), head32);
+        auto tails = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + size - 1)), tail32);
+        for (auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(heads, tails))); mask; mask &= mask - 1)
+            if (matches_at(first + count_trailing_zeros(mask)))
+                return first + count_trailing_zeros(mask);
+    }
+#endif
+
+#if defined(PY_STRING_SSE2)
+    auto head16 = _mm_set1_epi8(needle[0]);
+    auto tail16 = _mm_set1_epi8(needle[size - 1]);
+    for (; stop - first >= 16; first += 16) {
+        auto heads = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)), head16);
+        auto tails = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + size - 1)), tail16);
+        for (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(heads, tails))); mask; mask &= mask - 1)
+            if (matches_at(first + count_trailing_zeros(mask)))
+                return first + count_trailing_zeros(mask);
+    }
+#endif
+
+    for (; first != stop; ++first)
+        if (first[0] == needle[0] && first[size - 1] == needle[size - 1] && matches_at(first))
+            return first;
+
+    return last;
+}
+
+/* Returns the last occurrence of [needle, needle + size) in
+ * [first, last), or last. Mirror image of find_substring(). */
+inline const char* rfind_substring(const char* first, const char* last, const char* needle, std::size_t size) noexcept
+{
+    if (static_cast<std::size_t>(last - first) < size)
+        return last;
+    if (size == 0)
+        return last;
+    if (size == 1)
+        return rfind_byte(first, last, *needle);
+
+    /* Candidates are the starts in [first, stop) */
+    auto stop = last - size + 1;
+    auto matches_at = [needle, size](const char* pos) { return std::memcmp(pos + 1, needle + 1, size - 2) == 0; };
+
+#if defined(PY_STRING_AVX2)
+    auto head32 = _mm256_set1_epi8(needle[0]);
+    auto tail32 = _mm256_set1_epi8(needle[size - 1]);
+    for (; stop - first >= 32; stop -= 32) {
+        auto heads = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(stop - 32)), head32);
+        auto tails = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(stop - 32 + size - 1)), tail32);
+        for (auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(heads, tails))); mask; mask &= ~(0x80000000u >> count_leading_zeros(mask)))
+            if (matches_at(stop - 1 - count_leading_zeros(mask)))
+                return stop - 1 - count_leading_zeros(mask);
+    }
+#endif
+
+#if defined(PY_STRING_SSE2)
+    auto head16 = _mm_set1_epi8(needle[0]);
+    auto tail16 = _mm_set1_epi8(needle[size - 1]);
+    for (; stop - first >= 16; stop -= 16) {
+        auto heads = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(stop - 16)), head16);
+        auto tails = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(stop - 16 + size - 1)), tail16);
+        for (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(heads, tails))); mask; mask &= ~(0x80000000u >> count_leading_zeros(mask)))
+            if (matches_at(stop + 15 - count_leading_zeros(mask)))
+                return stop + 15 - count_leading_zeros(mask);
+    }
+#endif
+
+    while (stop != first) {
+        --stop;
+        if (stop[0] == needle[0] && stop[size - 1] == needle[size - 1] && matches_at(stop))
+            return stop;
+    }
+
+    return last;
+}
+
+/* Toggles bit 0x20 of every ASCII letter in [Low, Low + 25]. With Fold
+ * the byte is lowercased before the range check, so both cases are
+ * matched. Bytes outside of ASCII are never touched. */
+template <char Low, bool Fold>
+void flip_case(char* first, char* last) noexcept
+{
+    constexpr char Flip = 0x20;
+    constexpr char Fold_bits = Fold ? Flip : 0;
+
+#if defined(PY_STRING_AVX512)
+    auto flip_block = [](__m512i block) {
+        auto key = _mm512_or_si512(block, _mm512_set1_epi8(Fold_bits));
+        auto in_range = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(key, _mm512_set1_epi8(Low)), _mm512_set1_epi8(26));
+        return _mm512_xor_si512(block, _mm512_maskz_mov_epi8(in_range, _mm512_set1_epi8(Flip)));
+    };
+
+    for (; last - first >= 64; first += 64) {
+        auto block = _mm512_loadu_si512(first);
+        _mm512_storeu_si512(first, flip_block(block));
+    }
+
+    if (first != last) {
+        auto tail = _cvtu64_mask64(~0ull >> (64 - (last - first)));
+        auto block = _mm512_maskz_loadu_epi8(tail, first);
+        _mm512_mask_storeu_epi8(first, tail, flip_block(block));
+        first = last;
+    }
+#else
+#    if defined(PY_STRING_AVX2)
+    for (; last - first >= 32; first += 32) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        auto letters = in_range(_mm256_or_si256(block, _mm256_set1_epi8(Fold_bits)), Low, Low + 25);
+        block = _mm256_xor_si256(block, _mm256_and_si256(letters, _mm256_set1_epi8(Flip)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(first), block);
+    }
+#    endif
+
+#    if defined(PY_STRING_SSE2)
+    for (; last - first >= 16; first += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        auto letters = in_range(_mm_or_si128(block, _mm_set1_epi8(Fold_bits)), Low, Low + 25);
+        block = _mm_xor_si128(block, _mm_and_si128(letters, _mm_set1_epi8(Flip)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(first), block);
+    }
+#    endif
+#endif
+
+    for (; first != last; ++first) {
+        auto key = static_cast<unsigned char>(*first | Fold_bits);
+        if (static_cast<unsigned char>(key - Low) < 26)
+            *first ^= Flip;
+    }
+}
+
+inline void ascii_upper(char* first, char* last) noexcept
+{
+    flip_case<'a', false>(first, last);
+}
+
+inline void ascii_lower(char* first, char* last) noexcept
+{
+    flip_case<'A', false>(first, last);
+}
+
+inline void ascii_swapcase(char* first, char* last) noexcept
+{
+    flip_case<'a', true>(first, last);
+}
+
+/* Shuffle masks that move the bytes selected by an 8 bit mask to the
+ * front of an 8 byte group, and the number of selected bytes. */
+struct Compress_table {
+    std::uint64_t shuffles[256];
+    std::uint8_t counts[256];
+};
+
+constexpr Compress_table make_compress_table() noexcept
+{
+    Compress_table result {};
+    for (unsigned mask = 0; mask < 256; ++mask) {
+        std::uint64_t shuffle = 0;
+        unsigned count = 0;
+        for (unsigned bit = 0; bit < 8; ++bit)
+            if (mask & (1u << bit))
+                shuffle |= static_cast<std::uint64_t>(bit) << (8 * count++);
+        result.shuffles[mask] = shuffle;
+        result.counts[mask] = static_cast<std::uint8_t>(count);
+    }
+
+    return result;
+}
+
+inline constexpr Compress_table compress_table = make_compress_table();
+
+/* Running summary of the classes seen by scan_classes(). The "not_*"
+ * members are set once a byte outside of that class was seen. */
+struct Class_summary {
+    bool any_lower = false;
+    bool any_upper = false;
+    bool not_alpha = false;
+    bool not_digit = false;
+    bool not_alnum = false;
+    bool not_space = false;
+
+    void add(std::uint32_t lower, std::uint32_t upper, std::uint32_t digit, std::uint32_t space, std::uint32_t all) noexcept
+    {
+        any_lower |= lower != 0;
+        any_upper |= upper != 0;
+        not_alpha |= (lower | upper) != all;
+        not_digit |= digit != all;
+        not_alnum |= (lower | upper | digit) != all;
+        not_space |= space != all;
+    }
+
+    bool settled() const noexcept
+    {
+        return not_alnum && not_space && any_lower && any_upper;
+    }
+};
+
+/* Classifies [first, last) in a single pass, stopping as soon as
+ * stop(summary) holds. */
+template <typename Stop>
+Class_summary scan_classes(const char* first, const char* last, Stop stop) noexcept
+{
+    Class_summary summary;
+
+#if defined(PY_STRING_AVX2)
+    for (; last - first >= 32; first += 32) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        auto lower = static_cast<std::uint32_t>(_mm256_movemask_epi8(in_range(block, 'a', 'z')));
+        auto upper = static_cast<std::uint32_t>(_mm256_movemask_epi8(in_range(block, 'A', 'Z')));
+        summary.add(lower, upper, Digit_class {}.mask(block), Space_class {}.mask(block), 0xffffffff);
+        if (stop(summary))
+            return summary;
+    }
+#endif
+
+#if defined(PY_STRING_SSE2)
+    for (; last - first >= 16; first += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        auto lower = static_cast<std::uint32_t>(_mm_movemask_epi8(in_range(block, 'a', 'z')));
+        auto upper = static_cast<std::uint32_t>(_mm_movemask_epi8(in_range(block, 'A', 'Z')));
+        summary.add(lower, upper, Digit_class {}.mask(block), Space_class {}.mask(block), 0xffff);
+        if (stop(summary))
+            return summary;
+    }
+#endif
+
+    for (; first != last; ++first) {
+        auto c = static_cast<unsigned char>(*first);
+        summary.add(c >= 'a' && c <= 'z', c >= 'A' && c <= 'Z', Digit_class {}(c), Space_class {}(c), 1);
+        if (stop(summary))
+            return summary;
+    }
+
+    return summary;
+}
+}
+
+class SplitView;
+class LineView;
+class InternTable;
+struct Partition;
+
+/* Execution policy for the parallel overloads */
+struct Parallel {
+    /* Number of threads to use, 0 means one per hardware thread */
+    unsigned threads = 0;
+
+    static constexpr std::size_t Min_join_pieces = 1 << 14;
+    static constexpr std::size_t Min_search_bytes = 1 << 20;
+
+    /* How many tasks to split count units of work into, so that every
+     * task gets at least min_share units */
+    std::size_t tasks(std::size_t count, std::size_t min_share) const noexcept
+    {
+        std::size_t available = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        return std::max<std::size_t>(1, std::min(available, count / min_share));
+    }
+};
+
+/* Flags returned by classify() */
+struct Char_class {
+    enum : unsigned {
+        Alpha = 1u << 0,
+        Digit = 1u << 1,
+        Alnum = 1u << 2,
+        Space = 1u << 3,
+        Lower = 1u << 4,
+        Upper = 1u << 5,
+    };
+};
+
+/* Non-owning, read-only window into a character buffer.
+ * Provides the non-mutating part of the String API without
+ * allocating. The viewed buffer has to outlive the view. */
+struct StringView {
     using size_type = std::string::size_type;
 
-    String() = default;
+    constexpr StringView() noexcept = default;
 
-    String(std::string str)
-        : str(std::move(str))
+    constexpr StringView(const char* str, size_type len) noexcept
+        : ptr(str)
+        , length(len)
     {
     }
 
-    String(const char* str)
-        : str(str)
+    constexpr StringView(const char* str) noexcept
+        : ptr(str)
+        , length(std::char_traits<char>::length(str))
     {
     }
 
-    String copy() const
+    template <typename Traits, typename Allocator>
+    StringView(const std::basic_string<char, Traits, Allocator>& str) noexcept
+        : ptr(str.data())
+        , length(str.size())
     {
-        return String(str);
     }
 
-    size_type str_index(int rel_pos) const
+    constexpr StringView(std::string_view str) noexcept
+        : ptr(str.data())
+        , length(str.size())
+    {
+    }
+
+    explicit constexpr operator std::string_view() const noexcept
+    {
+        return { ptr, length };
+    }
+
+    explicit operator std::string() const
+    {
+        return { ptr, length };
+    }
+
+    size_type str_index(int rel_pos) const noexcept
     {
         return static_cast<size_type>(rel_pos >= 0 ? rel_pos : size() + rel_pos);
     }
 
-    bool empty() const
+    constexpr bool empty() const noexcept
+    {
+        return length == 0;
+    }
+
+    constexpr size_type size() const noexcept
+    {
+        return length;
+    }
+
+    constexpr size_type len() const noexcept
+    {
+        return length;
+    }
+
+    constexpr const char* data() const noexcept
+    {
+        return ptr;
+    }
+
+    const char& operator[](int pos) const noexcept
+    {
+        return ptr[str_index(pos)];
+    }
+
+    constexpr const char* begin() const noexcept
+    {
+        return ptr;
+    }
+
+    constexpr const char* end() const noexcept
+    {
+        return ptr + length;
+    }
+
+    /* from and to indexes are included */
+    StringView slice(int from, int to) const noexcept
+    {
+        if (empty())
+            return {};
+
+        auto first = str_index(from);
+        auto last = std::min(str_index(to), size() - 1);
+        if (first > last || first >= size())
+            return {};
+
+        return { ptr + first, last - first + 1 };
+    }
+
+    StringView operator()(int from, int to) const noexcept
+    {
+        return slice(from, to);
+    }
+
+    /* Non-mutating strips: the returned view only moves its start and
+     * end, so the cost depends on the stripped characters, not on the
+     * length of the string. */
+    StringView lstripped(const char ch = ' ') const noexcept
+    {
+        return lstripped(StringView(&ch, 1));
+    }
+
+    StringView lstripped(StringView chars) const noexcept
+    {
+        auto pos = std::min(std::string_view(*this).find_first_not_of(std::string_view(chars)), size());
+        return { ptr + pos, size() - pos };
+    }
+
+    StringView rstripped(const char ch = ' ') const noexcept
+    {
+        return rstripped(StringView(&ch, 1));
+    }
+
+    StringView rstripped(StringView chars) const noexcept
+    {
+        auto pos = std::string_view(*this).find_last_not_of(std::string_view(chars));
+        return { ptr, pos == Not_found ? 0 : pos + 1 };
+    }
+
+    StringView stripped(const char ch = ' ') const noexcept
+    {
+        return stripped(StringView(&ch, 1));
+    }
+
+    StringView stripped(StringView chars) const noexcept
+    {
+        return rstripped(chars).lstripped(chars);
+    }
+
+    bool contains(StringView string) const noexcept
+    {
+        if (string.empty())
+            return false;
+
+        return find(string) != Not_found;
+    }
+
+    size_type count(StringView value, int start_pos = 0) const noexcept
+    {
+        auto pos = str_index(start_pos);
+        if (pos > size())
+            return 0;
+
+        if (value.empty())
+            return size() - pos + 1;
+
+        size_type cnt = 0;
+        auto haystack = std::string_view(*this);
+        auto needle = std::string_view(value);
+        while ((pos = haystack.find(needle, pos)) != Not_found) {
+            ++cnt;
+            pos += value.size();
+        }
+
+        return cnt;
+    }
+
+    bool endswith(StringView value) const noexcept
+    {
+        return value.size() <= size()
+            && std::string_view(end() - value.size(), value.size()) == std::string_view(value);
+    }
+
+    size_type find(StringView value) const noexcept
+    {
+        return std::string_view(*this).find(std::string_view(value));
+    }
+
+    size_type index(StringView value) const noexcept
+    {
+        return find(value);
+    }
+
+    bool isalpha() const noexcept
+    {
+        return all_of(detail::Alpha_class {});
+    }
+
+    bool isdigit() const noexcept
+    {
+        return all_of(detail::Digit_class {});
+    }
+
+    bool isalnum() const noexcept
+    {
+        return all_of(detail::Alnum_class {});
+    }
+
+    /* True if there is at least one lowercase and no uppercase letter */
+    bool islower() const noexcept
+    {
+        auto summary = detail::scan_classes(begin(), end(), [](const detail::Class_summary& s) { return s.any_upper; });
+        return summary.any_lower && !summary.any_upper;
+    }
+
+    /* True if there is at least one uppercase and no lowercase letter */
+    bool isupper() const noexcept
+    {
+        auto summary = detail::scan_classes(begin(), end(), [](const detail::Class_summary& s) { return s.any_lower; });
+        return summary.any_upper && !summary.any_lower;
+    }
+
+    bool isspace() const noexcept
+    {
+        return all_of(detail::Space_class {});
+    }
+
+    /* Computes all of the is*() predicates in one pass. Returns a
+     * combination of Char_class flags, a flag is set if the matching
+     * predicate would return true. */
+    unsigned classify() const noexcept
+    {
+        if (empty())
+            return 0;
+
+        auto summary = detail::scan_classes(begin(), end(), [](const detail::Class_summary& s) { return s.settled(); });
+        unsigned flags = 0;
+        if (!summary.not_alpha)
+            flags |= Char_class::Alpha;
+        if (!summary.not_digit)
+            flags |= Char_class::Digit;
+        if (!summary.not_alnum)
+            flags |= Char_class::Alnum;
+        if (!summary.not_space)
+            flags |= Char_class::Space;
+        if (summary.any_lower && !summary.any_upper)
+            flags |= Char_class::Lower;
+        if (summary.any_upper && !summary.any_lower)
+            flags |= Char_class::Upper;
+        return flags;
+    }
+
+    size_type rfind(StringView value) const noexcept
+    {
+        return std::string_view(*this).rfind(std::string_view(value));
+    }
+
+    size_type rindex(StringView value) const noexcept
+    {
+        return rfind(value);
+    }
+
+    /* Parallel versions of the searches for very large strings. The
+     * string is cut into one chunk per thread, each chunk extended by
+     * the size of value so that matches crossing into the next chunk
+     * are found, and the results are merged in order. */
+    size_type count(StringView value, Parallel policy) const;
+
+    size_type find(StringView value, Parallel policy) const;
+
+    size_type rfind(StringView value, Parallel policy) const;
+
+    bool contains(StringView value, Parallel policy) const;
+
+    /* Lazy, allocation free split on runs of whitespace.
+     * At most maxsplit splits are done if it is not negative. */
+    SplitView split_view(int maxsplit = -1) const noexcept;
+
+    /* Lazy, allocation free split on every occurrence of sep. */
+    SplitView split_view(StringView sep, int maxsplit = -1) const;
+
+    /* Clears out and appends the parts of split_view(), so a container
+     * reused across calls keeps its capacity. The elements have to be
+     * constructible from StringView. */
+    template <typename Container>
+    Container& split_to(Container& out, int maxsplit = -1) const;
+
+    template <typename Container>
+    Container& split_to(Container& out, StringView sep, int maxsplit = -1) const;
+
+    /* Like split_to(), but at most maxsplit splits are done from the
+     * right. The parts are still in their original order. */
+    template <typename Container>
+    Container& rsplit_to(Container& out, int maxsplit = -1) const;
+
+    template <typename Container>
+    Container& rsplit_to(Container& out, StringView sep, int maxsplit = -1) const;
+
+    /* Python's str.partition(): the part before the first occurrence of
+     * sep, sep itself and the part after it, all views into this string.
+     * If sep is not found, the first part is the whole string. */
+    Partition partition(StringView sep) const;
+
+    /* Splits at the last occurrence of sep. If sep is not found, the
+     * last part is the whole string. */
+    Partition rpartition(StringView sep) const;
+
+    /* Lazy, allocation free splitlines() */
+    LineView splitlines_view(bool keep_line_breaks = false) const noexcept;
+
+    /* Splits like split_view() and interns every token */
+    std::vector<std::uint32_t> split(InternTable& table, int maxsplit = -1) const;
+
+    std::vector<std::uint32_t> split(InternTable& table, StringView sep, int maxsplit = -1) const;
+
+    bool startswith(StringView value) const noexcept
+    {
+        return value.size() <= size()
+            && std::string_view(begin(), value.size()) == std::string_view(value);
+    }
+
+private:
+    template <typename Class>
+    bool all_of(Class cls) const noexcept
+    {
+        return !empty() && detail::find_class<true>(begin(), end(), cls) == end();
+    }
+
+    const char* ptr = nullptr;
+    size_type length = 0;
+};
+
+/* Found through ADL for every string type of this library, comparing
+ * or printing them never needs a temporary String. */
+constexpr bool operator==(StringView lhs, StringView rhs) noexcept
+{
+    return std::string_view(lhs) == std::string_view(rhs);
+}
+
+constexpr bool operator!=(StringView lhs, StringView rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+inline std::ostream& operator<<(std::ostream& out, StringView string)
+{
+    return out.write(string.data(), static_cast<std::streamsize>(string.size()));
+}
+
+/* Result of partition() and rpartition(), works with structured
+ * bindings: auto [name, colon, value] = line.partition(":"); */
+struct Partition {
+    StringView head;
+    StringView sep;
+    StringView tail;
+};
+
+inline Partition StringView::partition(StringView sep) const
+{
+    if (sep.empty())
+        throw std::invalid_argument("empty separator");
+
+    auto found = detail::find_substring(begin(), end(), sep.data(), sep.size());
+    if (found == end())
+        return { *this, StringView(end(), 0), StringView(end(), 0) };
+
+    auto offset = static_cast<size_type>(found - begin());
+    return { StringView(begin(), offset), StringView(found, sep.size()), StringView(found + sep.size(), size() - offset - sep.size()) };
+}
+
+inline Partition StringView::rpartition(StringView sep) const
+{
+    if (sep.empty())
+        throw std::invalid_argument("empty separator");
+
+    auto found = detail::rfind_substring(begin(), end(), sep.data(), sep.size());
+    if (found == end())
+        return { StringView(begin(), 0), StringView(begin(), 0), *this };
+
+    auto offset = static_cast<size_type>(found - begin());
+    return { StringView(begin(), offset), StringView(found, sep.size()), StringView(found + sep.size(), size() - offset - sep.size()) };
+}
+
+/* Forward range of StringView tokens, produced one at a time
+ * with Python's str.split() semantics. Tokens point into the
+ * original buffer. */
+class SplitView {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StringView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StringView*;
+        using reference = const StringView&;
+
+        iterator() = default;
+
+        reference operator*() const noexcept
+        {
+            return token;
+        }
+
+        pointer operator->() const noexcept
+        {
+            return &token;
+        }
+
+        iterator& operator++()
+        {
+            advance();
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto copy = *this;
+            advance();
+            return copy;
+        }
+
+        friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return lhs.done == rhs.done && (lhs.done || lhs.token.data() == rhs.token.data());
+        }
+
+        friend bool operator!=(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class SplitView;
+
+        iterator(const SplitView& range)
+            : pos(range.string.begin())
+            , last(range.string.end())
+            , sep(range.sep)
+            , splits_left(range.maxsplit)
+        {
+            advance();
+        }
+
+        void advance()
+        {
+            if (consumed) {
+                done = true;
+                return;
+            }
+
+            if (sep.empty())
+                advance_whitespace();
+            else
+                advance_separator();
+        }
+
+        void advance_whitespace()
+        {
+            auto from = detail::find_not_space(pos, last);
+            if (from == last) {
+                done = true;
+                consumed = true;
+                return;
+            }
+
+            auto to = splits_left == 0 ? last : detail::find_space(from, last);
+            token = StringView(from, static_cast<StringView::size_type>(to - from));
+            pos = to;
+            consumed = to == last;
+            if (splits_left > 0)
+                --splits_left;
+        }
+
+        void advance_separator()
+        {
+            auto found = splits_left == 0 || pos == last ? last : detail::find_substring(pos, last, sep.data(), sep.size());
+            token = StringView(pos, static_cast<StringView::size_type>(found - pos));
+            if (found == last) {
+                consumed = true;
+                return;
+            }
+
+            pos = found + sep.size();
+            if (splits_left > 0)
+                --splits_left;
+        }
+
+        const char* pos = nullptr;
+        const char* last = nullptr;
+        StringView sep {};
+        StringView token {};
+        int splits_left = -1;
+        bool consumed = false;
+        bool done = false;
+    };
+
+    SplitView(StringView string, StringView sep, int maxsplit) noexcept
+        : string(string)
+        , sep(sep)
+        , maxsplit(maxsplit)
+    {
+    }
+
+    iterator begin() const
+    {
+        return iterator(*this);
+    }
+
+    iterator end() const
+    {
+        iterator it;
+        it.done = true;
+        return it;
+    }
+
+private:
+    StringView string;
+    StringView sep;
+    int maxsplit;
+};
+
+inline SplitView StringView::split_view(int maxsplit) const noexcept
+{
+    return SplitView(*this, StringView(), maxsplit);
+}
+
+inline SplitView StringView::split_view(StringView sep, int maxsplit) const
+{
+    if (sep.empty())
+        throw std::invalid_argument("empty separator");
+
+    return SplitView(*this, sep, maxsplit);
+}
+
+namespace detail {
+/* Calls f with the parts of Python's str.rsplit(), from the last one
+ * to the first one */
+template <typename F>
+void rsplit_whitespace(StringView string, int maxsplit, F f)
+{
+    auto first = string.begin();
+    for (auto end = string.end();;) {
+        auto last_word = rfind_not_space(first, end);
+        if (last_word == end)
+            return;
+
+        end = last_word + 1;
+        if (maxsplit == 0) {
+            f(StringView(first, static_cast<StringView::size_type>(end - first)));
+            return;
+        }
+
+        auto space = rfind_space(first, end);
+        auto start = space == end ? first : space + 1;
+        f(StringView(start, static_cast<StringView::size_type>(end - start)));
+        end = start;
+        if (maxsplit > 0)
+            --maxsplit;
+    }
+}
+
+template <typename F>
+void rsplit_separator(StringView string, StringView sep, int maxsplit, F f)
+{
+    if (sep.empty())
+        throw std::invalid_argument("empty separator");
+
+    auto first = string.begin();
+    for (auto end = string.end();;) {
+        auto found = maxsplit == 0 ? end : rfind_substring(first, end, sep.data(), sep.size());
+        if (found == end) {
+            f(StringView(first, static_cast<StringView::size_type>(end - first)));
+            return;
+        }
+
+        f(StringView(found + sep.size(), static_cast<StringView::size_type>(end - found - sep.size())));
+        end = found;
+        if (maxsplit > 0)
+            --maxsplit;
+    }
+}
+}
+
+template <typename Container>
+Container& StringView::split_to(Container& out, int maxsplit) const
+{
+    out.clear();
+    for (auto token : split_view(maxsplit))
+        out.emplace_back(token);
+
+    return out;
+}
+
+template <typename Container>
+Container& StringView::split_to(Container& out, StringView sep, int maxsplit) const
+{
+    out.clear();
+    for (auto token : split_view(sep, maxsplit))
+        out.emplace_back(token);
+
+    return out;
+}
+
+template <typename Container>
+Container& StringView::rsplit_to(Container& out, int maxsplit) const
+{
+    out.clear();
+    detail::rsplit_whitespace(*this, maxsplit, [&out](StringView token) { out.emplace_back(token); });
+    std::reverse(out.begin(), out.end());
+
+    return out;
+}
+
+template <typename Container>
+Container& StringView::rsplit_to(Container& out, StringView sep, int maxsplit) const
+{
+    out.clear();
+    detail::rsplit_separator(*this, sep, maxsplit, [&out](StringView token) { out.emplace_back(token); });
+    std::reverse(out.begin(), out.end());
+
+    return out;
+}
+
+/* Forward range of the lines of a string as StringView, with the
+ * semantics of String::splitlines() and LineReader: every line boundary
+ * of Python's str.splitlines() in UTF-8 text ends a line. Lines point
+ * into the original buffer. */
+class LineView {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StringView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StringView*;
+        using reference = const StringView&;
+
+        iterator() = default;
+
+        reference operator*() const noexcept
+        {
+            return line;
+        }
+
+        pointer operator->() const noexcept
+        {
+            return &line;
+        }
+
+        iterator& operator++() noexcept
+        {
+            advance();
+            return *this;
+        }
+
+        iterator operator++(int) noexcept
+        {
+            auto copy = *this;
+            advance();
+            return copy;
+        }
+
+        friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return lhs.line.data() == rhs.line.data();
+        }
+
+        friend bool operator!=(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class LineView;
+
+        iterator(const char* first, const char* last, bool keep_line_breaks) noexcept
+            : pos(first)
+            , last(last)
+            , keep_line_breaks(keep_line_breaks)
+        {
+            advance();
+        }
+
+        void advance() noexcept
+        {
+            if (pos == last) {
+                line = StringView();
+                return;
+            }
+
+            std::size_t length = 0;
+            auto end = detail::find_line_break(pos, last, true, length);
+            auto line_end = keep_line_breaks ? end + length : end;
+            line = StringView(pos, static_cast<StringView::size_type>(line_end - pos));
+            pos = end == last ? last : end + length;
+        }
+
+        const char* pos = nullptr;
+        const char* last = nullptr;
+        StringView line {};
+        bool keep_line_breaks = false;
+    };
+
+    LineView(StringView string, bool keep_line_breaks) noexcept
+        : string(string)
+        , keep_line_breaks(keep_line_breaks)
+    {
+    }
+
+    iterator begin() const noexcept
+    {
+        return iterator(string.begin(), string.end(), keep_line_breaks);
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator();
+    }
+
+private:
+    StringView string;
+    bool keep_line_breaks;
+};
+
+inline LineView StringView::splitlines_view(bool keep_line_breaks) const noexcept
+{
+    return LineView(*this, keep_line_breaks);
+}
+
+/* Maps string content to a stable integer id and a single canonical
+ * copy, so that equal strings compare as equal ids. The table is split
+ * into shards by hash: lookups never lock, inserts lock one shard.
+ * Interned strings live as long as the table. */
+class InternTable {
+public:
+    using id_type = std::uint32_t;
+    static constexpr id_type Not_interned = ~id_type(0);
+
+    explicit InternTable(unsigned shard_bits = 6)
+        : shard_bits(shard_bits)
+        , shards(new Shard[std::size_t(1) << shard_bits])
+    {
+    }
+
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+
+    /* Returns the id of string, adding it first if needed */
+    id_type intern(StringView string)
+    {
+        auto hash = std::hash<std::string_view>()(std::string_view(string));
+        auto& shard = shards[hash & shard_mask()];
+        if (auto entry = shard.find(string, hash >> shard_bits))
+            return entry->id;
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (auto entry = shard.find(string, hash >> shard_bits))
+            return entry->id;
+
+        auto local = shard.count.load(std::memory_order_relaxed);
+        if (local >= (Not_interned >> shard_bits))
+            throw std::length_error("intern table is full");
+
+        return shard.insert(string, hash >> shard_bits, (local << shard_bits) | static_cast<id_type>(hash & shard_mask()))->id;
+    }
+
+    /* Returns the id of string or Not_interned, never modifies the table */
+    id_type find(StringView string) const noexcept
+    {
+        auto hash = std::hash<std::string_view>()(std::string_view(string));
+        auto entry = shards[hash & shard_mask()].find(string, hash >> shard_bits);
+        return entry ? entry->id : Not_interned;
+    }
+
+    /* The canonical copy of an interned string */
+    StringView view(id_type id) const noexcept
+    {
+        auto entry = shards[id & shard_mask()].entry(id >> shard_bits);
+        return { entry->data, entry->size };
+    }
+
+    std::size_t size() const noexcept
+    {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i <= shard_mask(); ++i)
+            total += shards[i].count.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    /* The most slots any lookup has to probe, a measure of clustering */
+    std::size_t max_probe_length() const
+    {
+        std::size_t longest = 0;
+        for (std::size_t i = 0; i <= shard_mask(); ++i) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            auto slots = shards[i].table.load(std::memory_order_acquire);
+            for (std::size_t slot = 0; slot <= slots->mask; ++slot)
+                if (auto entry = slots->slots[slot].load(std::memory_order_relaxed))
+                    longest = std::max(longest, ((slot - entry->hash) & slots->mask) + 1);
+        }
+        return longest;
+    }
+
+private:
+    /* hash holds the bits above the shard index. The low bits are the
+     * same for every entry of a shard and would all probe from the same
+     * slot. */
+    struct Entry {
+        const char* data;
+        std::size_t size;
+        std::size_t hash;
+        id_type id;
+    };
+
+    /* Open addressing table of entry pointers. Replaced tables are kept
+     * alive, readers may still be probing them. */
+    struct Slots {
+        explicit Slots(std::size_t capacity)
+            : mask(capacity - 1)
+            , slots(new std::atomic<const Entry*>[capacity])
+        {
+            for (std::size_t i = 0; i < capacity; ++i)
+                slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        std::size_t mask;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    /* Entries are stored in blocks of First_block << k entries, so the
+     * block of an index is found with one bit scan and entries never
+     * move once written. */
+    static constexpr std::size_t First_block = 256;
+    static constexpr std::size_t Max_blocks = 32;
+    static constexpr std::size_t Text_block = 64 * 1024;
+
+    struct Shard {
+        Shard()
+        {
+            tables.emplace_back(new Slots(64));
+            table.store(tables.back().get(), std::memory_order_relaxed);
+            for (auto& block : blocks)
+                block.store(nullptr, std::memory_order_relaxed);
+        }
+
+        const Entry* find(StringView string, std::size_t hash) const noexcept
+        {
+            auto slots = table.load(std::memory_order_acquire);
+            for (auto i = hash;; ++i) {
+                auto entry = slots->slots[i & slots->mask].load(std::memory_order_acquire);
+                if (!entry)
+                    return nullptr;
+                if (entry->hash == hash && StringView(entry->data, entry->size) == string)
+                    return entry;
+            }
+        }
+
+        const Entry* entry(std::size_t index) const noexcept
+        {
+            auto block = block_of(index);
+            auto first = First_block * ((std::size_t(1) << block) - 1);
+            return blocks[block].load(std::memory_order_acquire) + (index - first);
+        }
+
+        /* Called with the mutex held */
+        const Entry* insert(StringView string, std::size_t hash, id_type id)
+        {
+            auto index = count.load(std::memory_order_relaxed);
+            auto block = block_of(index);
+            if (!blocks[block].load(std::memory_order_relaxed)) {
+                entry_blocks.emplace_back(new Entry[First_block << block]);
+                blocks[block].store(entry_blocks.back().get(), std::memory_order_release);
+            }
+
+            auto entry = const_cast<Entry*>(this->entry(index));
+            *entry = { store(string), string.size(), hash, id };
+
+            auto slots = table.load(std::memory_order_relaxed);
+            if (2 * (index + 1) > slots->mask + 1)
+                slots = grow(*slots);
+            publish(*slots, entry);
+
+            count.store(index + 1, std::memory_order_release);
+            return entry;
+        }
+
+        static std::size_t block_of(std::size_t index) noexcept
+        {
+            std::size_t block = 0;
+            for (auto n = index / First_block + 1; n > 1; n >>= 1)
+                ++block;
+            return block;
+        }
+
+        const char* store(StringView string)
+        {
+            if (string.size() > Text_block / 4) {
+                text_blocks.emplace_back(new char[string.size()]);
+                std::memcpy(text_blocks.back().get(), string.data(), string.size());
+                return text_blocks.back().get();
+            }
+
+            if (!text || text_used + string.size() > Text_block) {
+                text_blocks.emplace_back(new char[Text_block]);
+                text = text_blocks.back().get();
+                text_used = 0;
+            }
+
+            auto copy = text + text_used;
+            std::memcpy(copy, string.data(), string.size());
+            text_used += string.size();
+            return copy;
+        }
+
+        Slots* grow(const Slots& old)
+        {
+            tables.emplace_back(new Slots(2 * (old.mask + 1)));
+            auto slots = tables.back().get();
+            for (std::size_t i = 0; i <= old.mask; ++i)
+                if (auto entry = old.slots[i].load(std::memory_order_relaxed))
+                    publish(*slots, entry);
+
+            table.store(slots, std::memory_order_release);
+            return slots;
+        }
+
+        static void publish(Slots& slots, const Entry* entry) noexcept
+        {
+            auto i = entry->hash;
+            while (slots.slots[i & slots.mask].load(std::memory_order_relaxed))
+                ++i;
+            slots.slots[i & slots.mask].store(entry, std::memory_order_release);
+        }
+
+        std::mutex mutex;
+        std::atomic<Slots*> table;
+        std::atomic<id_type> count { 0 };
+        std::atomic<Entry*> blocks[Max_blocks];
+        std::vector<std::unique_ptr<Slots>> tables;
+        std::vector<std::unique_ptr<Entry[]>> entry_blocks;
+        std::vector<std::unique_ptr<char[]>> text_blocks;
+        char* text = nullptr;
+        std::size_t text_used = 0;
+    };
+
+    std::size_t shard_mask() const noexcept
+    {
+        return (std::size_t(1) << shard_bits) - 1;
+    }
+
+    unsigned shard_bits;
+    std::unique_ptr<Shard[]> shards;
+};
+
+inline std::vector<std::uint32_t> StringView::split(InternTable& table, int maxsplit) const
+{
+    std::vector<std::uint32_t> result;
+    for (auto token : split_view(maxsplit))
+        result.push_back(table.intern(token));
+
+    return result;
+}
+
+inline std::vector<std::uint32_t> StringView::split(InternTable& table, StringView sep, int maxsplit) const
+{
+    std::vector<std::uint32_t> result;
+    for (auto token : split_view(sep, maxsplit))
+        result.push_back(table.intern(token));
+
+    return result;
+}
+
+/* Byte translation table for String::translate(), see
+ * String::maketrans(). Every byte is mapped to a single byte or
+ * deleted. */
+class Translation {
+public:
+    /* Maps from[i] to to[i] and deletes every byte of deletechars */
+    Translation(StringView from, StringView to, StringView deletechars = {})
+    {
+        if (from.size() != to.size())
+            throw std::invalid_argument("maketrans arguments must have same length");
+
+        for (int c = 0; c < 256; ++c)
+            table[c] = static_cast<unsigned char>(c);
+        for (StringView::size_type i = 0; i < from.size(); ++i)
+            table[static_cast<unsigned char>(from.data()[i])] = static_cast<unsigned char>(to.data()[i]);
+        for (unsigned char c : deletechars)
+            deleted[c >> 3] |= static_cast<std::uint8_t>(1u << (c & 7));
+
+        /* Tables for the nibble lookups of the SIMD kernel: one 16 byte
+         * row per high nibble with a changed mapping, and the deleted
+         * bitmap transposed to be indexed by the low nibble. */
+        for (int c = 0; c < 256; ++c) {
+            if (table[c] != c)
+                mapped_rows |= static_cast<std::uint16_t>(1u << (c >> 4));
+            if (deletes(static_cast<unsigned char>(c)))
+                (c < 128 ? delete_low : delete_high)[c & 15] |= static_cast<std::uint8_t>(1u << ((c >> 4) & 7));
+        }
+        any_deleted = std::any_of(std::begin(deleted), std::end(deleted), [](std::uint8_t bits) { return bits != 0; });
+    }
+
+    unsigned char map(unsigned char c) const noexcept
+    {
+        return table[c];
+    }
+
+    bool deletes(unsigned char c) const noexcept
+    {
+        return (deleted[c >> 3] >> (c & 7)) & 1;
+    }
+
+    /* Translates [first, last) in place, returns the new end */
+    char* apply(char* first, char* last) const noexcept
+    {
+        auto out = first;
+
+#if defined(PY_STRING_SSSE3)
+        for (; last - first >= 16; first += 16) {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            auto mapped = map_block(block);
+            if (!any_deleted) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), mapped);
+                out += 16;
+                continue;
+            }
+
+            /* Stream compaction of the kept bytes, 8 bytes at a time.
+             * Stores never pass the end of the block just loaded. */
+            auto keep = ~static_cast<unsigned>(_mm_movemask_epi8(delete_mask(block))) & 0xffff;
+            auto low = _mm_shuffle_epi8(mapped, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&detail::compress_table.shuffles[keep & 0xff])));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), low);
+            out += detail::compress_table.counts[keep & 0xff];
+            auto high = _mm_shuffle_epi8(_mm_srli_si128(mapped, 8), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&detail::compress_table.shuffles[keep >> 8])));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), high);
+            out += detail::compress_table.counts[keep >> 8];
+        }
+#endif
+
+        for (; first != last; ++first) {
+            auto c = static_cast<unsigned char>(*first);
+            if (!deletes(c))
+                *out++ = static_cast<char>(table[c]);
+        }
+
+        return out;
+    }
+
+private:
+#if defined(PY_STRING_SSSE3)
+    __m128i map_block(__m128i block) const noexcept
+    {
+        auto low = _mm_and_si128(block, _mm_set1_epi8(0x0f));
+        auto high = _mm_and_si128(_mm_srli_epi16(block, 4), _mm_set1_epi8(0x0f));
+        for (unsigned rows = mapped_rows; rows; rows &= rows - 1) {
+            auto row = detail::count_trailing_zeros(rows);
+            auto selected = _mm_cmpeq_epi8(high, _mm_set1_epi8(static_cast<char>(row)));
+            auto mapped = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table + row * 16)), low);
+            block = _mm_or_si128(_mm_and_si128(selected, mapped), _mm_andnot_si128(selected, block));
+        }
+
+        return block;
+    }
+
+    __m128i delete_mask(__m128i block) const noexcept
+    {
+        auto low = _mm_and_si128(block, _mm_set1_epi8(0x0f));
+        auto high = _mm_and_si128(_mm_srli_epi16(block, 4), _mm_set1_epi8(0x0f));
+        auto from_low = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(delete_low)), low);
+        auto from_high = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(delete_high)), low);
+        auto is_high = _mm_cmplt_epi8(block, _mm_setzero_si128());
+        auto bits = _mm_or_si128(_mm_and_si128(is_high, from_high), _mm_andnot_si128(is_high, from_low));
+        auto bit = _mm_shuffle_epi8(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128), high);
+        return _mm_cmpeq_epi8(_mm_and_si128(bits, bit), bit);
+    }
+#endif
+
+    unsigned char table[256];
+    std::uint8_t deleted[32] {};
+    std::uint8_t delete_low[16] {};
+    std::uint8_t delete_high[16] {};
+    std::uint16_t mapped_rows = 0;
+    bool any_deleted = false;
+};
+
+namespace detail {
+template <typename Range, typename = void>
+struct is_string_range : std::false_type {
+};
+
+/* Ranges whose elements convert to StringView: containers of String,
+ * StringView, std::string or const char*, SplitView, ... */
+template <typename Range>
+struct is_string_range<Range, std::void_t<decltype(std::begin(std::declval<const Range&>()))>>
+    : std::is_convertible<decltype(*std::begin(std::declval<const Range&>())), StringView> {
+};
+
+/* Runs task(0) ... task(tasks - 1), the last one on the calling thread */
+template <typename Task>
+void run_parallel(std::size_t tasks, Task task)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(tasks - 1);
+    for (std::size_t i = 0; i + 1 < tasks; ++i)
+        threads.emplace_back(task, i);
+
+    task(tasks - 1);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+/* Position of the first match of needle in text that starts in
+ * [from, to), or Not_found */
+inline std::size_t next_match(StringView text, StringView needle, std::size_t from, std::size_t to) noexcept
+{
+    if (from >= to)
+        return Not_found;
+
+    auto last = text.begin() + std::min(to + needle.size() - 1, text.size());
+    /* Dense matches are mostly found right at from */
+    if (text.begin() + from + needle.size() <= last && std::memcmp(text.begin() + from, needle.data(), needle.size()) == 0)
+        return from;
+    auto found = find_substring(text.begin() + from, last, needle.data(), needle.size());
+    return found == last ? Not_found : static_cast<std::size_t>(found - text.begin());
+}
+
+/* Non-overlapping matches of needle in text starting in [from, to),
+ * counted greedily from from. last_end is set to the end of the last
+ * match, or 0 without a match. */
+struct Match_count {
+    std::size_t count = 0;
+    std::size_t last_end = 0;
+};
+
+inline Match_count count_matches(StringView text, StringView needle, std::size_t from, std::size_t to) noexcept
+{
+    Match_count result;
+    for (auto pos = next_match(text, needle, from, to); pos != Not_found; pos = next_match(text, needle, pos + needle.size(), to)) {
+        ++result.count;
+        result.last_end = pos + needle.size();
+    }
+
+    return result;
+}
+
+/* Counts of the chunk [from, to) for every position a match of the chunk
+ * before can end at. Such a match ends before from + needle.size(), so
+ * entries holds the distinct first matches at or after the positions
+ * [from, from + needle.size()), sorted, each with the count made
+ * greedily from it. searches is the number of searches it took. */
+struct Chunk_count {
+    std::vector<std::pair<std::size_t, Match_count>> entries;
+    std::size_t searches = 0;
+
+    /* The count of the chunk when the chunk before ends at carry */
+    Match_count after(std::size_t carry) const noexcept
+    {
+        auto entry = std::lower_bound(entries.begin(), entries.end(), carry, [](const auto& entry, std::size_t pos) { return entry.first < pos; });
+        return entry == entries.end() ? Match_count {} : entry->second;
+    }
+};
+
+/* The chains of matches from every entry are walked together, always
+ * advancing the one furthest behind. A chain that reaches the position
+ * of another one joins it and is not walked any further: from then on
+ * it counts the same matches. */
+inline Chunk_count count_chunk(StringView text, StringView needle, std::size_t from, std::size_t to)
+{
+    Chunk_count result;
+    for (auto entry = from; entry < from + needle.size(); ++entry) {
+        auto pos = next_match(text, needle, entry, to);
+        ++result.searches;
+        if (pos == Not_found)
+            break;
+        result.entries.push_back({ pos, {} });
+        entry = pos;
+    }
+
+    struct Chain {
+        std::size_t pos;
+        std::size_t index;
+        Match_count counted;
+    };
+    struct Join {
+        std::size_t index;
+        std::size_t target;
+        std::size_t target_count;
+    };
+    auto chains = std::vector<Chain> {};
+    for (std::size_t index = 0; index < result.entries.size(); ++index)
+        chains.push_back({ result.entries[index].first, index, {} });
+    std::vector<Join> joins;
+
+    auto searches = result.searches;
+    auto advance = [&](Chain& chain) {
+        ++chain.counted.count;
+        chain.counted.last_end = chain.pos + needle.size();
+        chain.pos = next_match(text, needle, chain.counted.last_end, to);
+        ++searches;
+    };
+
+    /* No two chains are at the same position. The one furthest behind
+     * is walked until it passes another one. */
+    while (chains.size() > 1) {
+        std::size_t behind = 0;
+        auto next = Not_found;
+        for (std::size_t i = 1; i < chains.size(); ++i) {
+            if (chains[i].pos < chains[behind].pos) {
+                next = chains[behind].pos;
+                behind = i;
+            } else {
+                next = std::min(next, chains[i].pos);
+            }
+        }
+
+        auto chain = chains[behind];
+        do
+            advance(chain);
+        while (chain.pos < next);
+
+        std::size_t other = 0;
+        while (other < chains.size() && (other == behind || chains[other].pos != chain.pos))
+            ++other;
+        if (other < chains.size())
+            joins.push_back({ chain.index, chains[other].index, chains[other].counted.count });
+        if (other < chains.size() || chain.pos == Not_found) {
+            result.entries[chain.index].second = chain.counted;
+            chains[behind] = chains.back();
+            chains.pop_back();
+        } else {
+            chains[behind] = chain;
+        }
+    }
+
+    if (!chains.empty()) {
+        auto chain = chains.front();
+        while (chain.pos != Not_found)
+            advance(chain);
+        result.entries[chain.index].second = chain.counted;
+    }
+    result.searches = searches;
+
+    for (auto join = joins.rbegin(); join != joins.rend(); ++join) {
+        auto& joined = result.entries[join->index].second;
+        const auto& target = result.entries[join->target].second;
+        joined.count += target.count - join->target_count;
+        joined.last_end = target.last_end;
+    }
+
+    return result;
+}
+}
+
+inline StringView::size_type StringView::count(StringView value, Parallel policy) const
+{
+    auto tasks = value.empty() ? 1 : policy.tasks(size(), std::max(Parallel::Min_search_bytes, 2 * value.size()));
+    if (tasks <= 1)
+        return count(value);
+
+    auto bound = [this, tasks](size_type task) { return size() * task / tasks; };
+    std::vector<detail::Chunk_count> chunks(tasks);
+    detail::run_parallel(tasks, [&](size_type task) { chunks[task] = detail::count_chunk(*this, value, bound(task), bound(task + 1)); });
+
+    size_type total = 0;
+    size_type carry = 0;
+    for (const auto& chunk : chunks) {
+        auto counted = chunk.after(carry);
+        total += counted.count;
+        carry = std::max(carry, counted.last_end);
+    }
+
+    return total;
+}
+
+/* Every chunk is searched in blocks, and a thread stops as soon as a
+ * match was found before its next block */
+inline StringView::size_type StringView::find(StringView value, Parallel policy) const
+{
+    constexpr size_type Block = 1 << 16;
+    auto tasks = value.empty() ? 1 : policy.tasks(size(), std::max(Parallel::Min_search_bytes, 2 * value.size()));
+    if (tasks <= 1)
+        return find(value);
+
+    std::atomic<size_type> best { Not_found };
+    detail::run_parallel(tasks, [&](size_type task) {
+        auto to = size() * (task + 1) / tasks;
+        for (auto from = size() * task / tasks; from < to && from < best.load(std::memory_order_relaxed); from += Block) {
+            auto pos = detail::next_match(*this, value, from, std::min(from + Block, to));
+            if (pos == Not_found)
+                continue;
+
+            auto current = best.load(std::memory_order_relaxed);
+            while (pos < current && !best.compare_exchange_weak(current, pos, std::memory_order_relaxed)) {
+            }
+            return;
+        }
+    });
+
+    return best.load();
+}
+
+inline StringView::size_type StringView::rfind(StringView value, Parallel policy) const
+{
+    constexpr size_type Block = 1 << 16;
+    auto tasks = value.empty() ? 1 : policy.tasks(size(), std::max(Parallel::Min_search_bytes, 2 * value.size()));
+    if (tasks <= 1)
+        return rfind(value);
+
+    /* One past the last match, 0 while there is none */
+    std::atomic<size_type> best { 0 };
+    detail::run_parallel(tasks, [&](size_type task) {
+        auto from = size() * task / tasks;
+        for (auto to = size() * (task + 1) / tasks; to > from && to > best.load(std::memory_order_relaxed);) {
+            auto block_from = to - std::min(Block, to - from);
+            auto window = std::min(to + value.size() - 1, size()) - block_from;
+            auto pos = std::string_view(data() + block_from, window).rfind(std::string_view(value));
+            to = block_from;
+            if (pos == Not_found)
+                continue;
+
+            auto found = block_from + pos + 1;
+            auto current = best.load(std::memory_order_relaxed);
+            while (found > current && !best.compare_exchange_weak(current, found, std::memory_order_relaxed)) {
+            }
+            return;
+        }
+    });
+
+    auto found = best.load();
+    return found ? found - 1 : Not_found;
+}
+
+inline bool StringView::contains(StringView value, Parallel policy) const
+{
+    return !value.empty() && find(value, policy) != Not_found;
+}
+
+/* Monotonic arena: allocations bump a pointer through a list of
+ * blocks and deallocation does nothing. reset() makes all of the
+ * memory available again at once, keeping the blocks for reuse, so a
+ * request handler that resets its arena stops calling malloc after
+ * the first few requests. Usable directly as a std::pmr memory
+ * resource. Not thread safe, use one arena per thread or request. */
+class Arena : public std::pmr::memory_resource {
+public:
+    explicit Arena(std::size_t block_size = 64 * 1024)
+        : block_size(block_size)
+    {
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() override
+    {
+        release();
+    }
+
+    void* allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        for (; current < blocks.size(); ++current, offset = 0)
+            if (auto ptr = bump(blocks[current], bytes, alignment))
+                return ptr;
+
+        auto size = std::max(block_size, bytes + alignment);
+        blocks.push_back({ static_cast<char*>(::operator new(size)), size });
+        current = blocks.size() - 1;
+        return bump(blocks[current], bytes, alignment);
+    }
+
+    void deallocate(void*, std::size_t, std::size_t = alignof(std::max_align_t)) noexcept
+    {
+    }
+
+    /* Makes all of the memory available again, every string allocated
+     * from this arena must be gone by then */
+    void reset() noexcept
+    {
+        current = 0;
+        offset = 0;
+    }
+
+    /* Returns all blocks to the global heap */
+    void release() noexcept
+    {
+        for (auto& block : blocks)
+            ::operator delete(block.data);
+        blocks.clear();
+        reset();
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        std::size_t total = 0;
+        for (const auto& block : blocks)
+            total += block.size;
+        return total;
+    }
+
+private:
+    struct Block {
+        char* data;
+        std::size_t size;
+    };
+
+    void* bump(const Block& block, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        auto base = reinterpret_cast<std::uintptr_t>(block.data);
+        auto aligned = (base + offset + alignment - 1) & ~(alignment - 1);
+        if (aligned - base + bytes > block.size)
+            return nullptr;
+
+        offset = aligned - base + bytes;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, std::size_t, std::size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::vector<Block> blocks;
+    std::size_t block_size;
+    std::size_t current = 0;
+    std::size_t offset = 0;
+};
+
+/* Allocator handing out memory from an Arena, without the virtual
+ * calls of std::pmr::polymorphic_allocator */
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator(Arena& arena) noexcept
+        : arena(&arena)
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+        : arena(other.arena)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept
+    {
+    }
+
+    template <typename U>
+    friend bool operator==(const ArenaAllocator& lhs, const ArenaAllocator<U>& rhs) noexcept
+    {
+        return lhs.arena == rhs.arena;
+    }
+
+    template <typename U>
+    friend bool operator!=(const ArenaAllocator& lhs, const ArenaAllocator<U>& rhs) noexcept
+    {
+        return lhs.arena != rhs.arena;
+    }
+
+    Arena* arena;
+};
+
+template <typename Allocator>
+struct BasicString;
+
+/* Lazy result of operator+. Keeps views of its operands and builds the
+ * string with a single allocation once it is converted to a BasicString,
+ * so a + b + c + d does not create intermediate strings. Temporary
+ * strings are never viewed, operator+ builds a BasicString right away
+ * when one of them is an operand. The other operands must outlive the
+ * expression if it is stored with auto.
+ *
+ * The transforming and searching methods of BasicString are available
+ * on the expression, so (a + b).upper() works; they build the string
+ * first. Methods returning views or pointers into the result
+ * (c_str(), split_view(), partition(), ...) are not, convert with
+ * String(a + b) first.
+ *
+ * The expression converts to a StringView of a copy that it builds
+ * and keeps, so it can be passed wherever a StringView is taken:
+ * s.find(a + b), s.replace(x, a + b). Like a view of a temporary
+ * String, that view is only valid until the end of the full
+ * expression. */
+template <typename Allocator, typename Lhs, typename Rhs>
+class Concat {
+public:
+    using size_type = std::string::size_type;
+
+    Concat(const Allocator& alloc, Lhs lhs, Rhs rhs)
+        : alloc(alloc)
+        , lhs(lhs)
+        , rhs(rhs)
+        , built(alloc)
+    {
+    }
+
+    Allocator get_allocator() const
+    {
+        return alloc;
+    }
+
+    size_type size() const noexcept
+    {
+        return size_of(lhs) + size_of(rhs);
+    }
+
+    /* Calls f with a StringView of every operand, in order */
+    template <typename F>
+    void for_each_piece(F&& f) const
+    {
+        visit(lhs, f);
+        visit(rhs, f);
+    }
+
+    template <typename String>
+    void append_to(String& out) const
+    {
+        for_each_piece([&out](StringView piece) { out.append(piece.data(), piece.size()); });
+    }
+
+    /* Views a copy built on first use and owned by the expression */
+    operator StringView() const
+    {
+        if (built.size() != size()) {
+            built.clear();
+            built.reserve(size());
+            append_to(built);
+        }
+        return { built.data(), built.size() };
+    }
+
+    /* Whether any operand points into [first, last) */
+    bool views(const char* first, const char* last) const noexcept
+    {
+        auto result = false;
+        for_each_piece([&](StringView piece) { result = result || detail::points_into(piece.data(), first, last); });
+        return result;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    size_type len() const noexcept
+    {
+        return size();
+    }
+
+    BasicString<Allocator> upper() const
+    {
+        return std::move(build().upper());
+    }
+
+    BasicString<Allocator> lower() const
+    {
+        return std::move(build().lower());
+    }
+
+    BasicString<Allocator> swapcase() const
+    {
+        return std::move(build().swapcase());
+    }
+
+    BasicString<Allocator> casefold() const
+    {
+        return std::move(build().casefold());
+    }
+
+    BasicString<Allocator> capitalize() const
+    {
+        return std::move(build().capitalize());
+    }
+
+    BasicString<Allocator> lstrip(const char ch = ' ') const
+    {
+        return std::move(build().lstrip(ch));
+    }
+
+    BasicString<Allocator> lstrip(StringView chars) const
+    {
+        return std::move(build().lstrip(chars));
+    }
+
+    BasicString<Allocator> rstrip(const char ch = ' ') const
+    {
+        return std::move(build().rstrip(ch));
+    }
+
+    BasicString<Allocator> rstrip(StringView chars) const
+    {
+        return std::move(build().rstrip(chars));
+    }
+
+    BasicString<Allocator> strip(const char ch = ' ') const
+    {
+        return std::move(build().strip(ch));
+    }
+
+    BasicString<Allocator> strip(StringView chars) const
+    {
+        return std::move(build().strip(chars));
+    }
+
+    BasicString<Allocator> replace(StringView oldvalue, StringView newvalue, int count = -1) const
+    {
+        return std::move(build().replace(oldvalue, newvalue, count));
+    }
+
+    BasicString<Allocator> zfill(size_type len) const
+    {
+        return std::move(build().zfill(len));
+    }
+
+    template <typename Translation>
+    BasicString<Allocator> translate(const Translation& table) const
+    {
+        return std::move(build().translate(table));
+    }
+
+    BasicString<Allocator> slice(int from, int to) const
+    {
+        return build().slice(from, to);
+    }
+
+    size_type find(StringView value) const
+    {
+        return build().find(value);
+    }
+
+    size_type rfind(StringView value) const
+    {
+        return build().rfind(value);
+    }
+
+    size_type count(StringView value) const
+    {
+        return build().count(value);
+    }
+
+    bool contains(StringView value) const
+    {
+        return build().contains(value);
+    }
+
+    bool startswith(StringView value) const
+    {
+        return build().startswith(value);
+    }
+
+    bool endswith(StringView value) const
+    {
+        return build().endswith(value);
+    }
+
+    auto split(int maxsplit = -1) const
+    {
+        return build().split(maxsplit);
+    }
+
+    auto split(StringView sep, int maxsplit = -1) const
+    {
+        return build().split(sep, maxsplit);
+    }
+
+    auto rsplit(int maxsplit = -1) const
+    {
+        return build().rsplit(maxsplit);
+    }
+
+    auto rsplit(StringView sep, int maxsplit = -1) const
+    {
+        return build().rsplit(sep, maxsplit);
+    }
+
+    auto splitlines(bool keep_line_breaks = false) const
+    {
+        return build().splitlines(keep_line_breaks);
+    }
+
+    /* Temporaries are appended right away instead of being viewed */
+    friend BasicString<Allocator> operator+(const Concat& lhs, BasicString<Allocator>&& rhs)
+    {
+        auto result = lhs.build(rhs.size());
+        result += rhs;
+        return result;
+    }
+
+    friend BasicString<Allocator> operator+(const Concat& lhs, std::string&& rhs)
+    {
+        auto result = lhs.build(rhs.size());
+        result += rhs;
+        return result;
+    }
+
+    friend Concat<Allocator, Concat, StringView> operator+(const Concat& lhs, const BasicString<Allocator>& rhs)
+    {
+        return { lhs.alloc, lhs, rhs };
+    }
+
+    friend Concat<Allocator, Concat, StringView> operator+(const Concat& lhs, const std::string& rhs)
+    {
+        return { lhs.alloc, lhs, rhs };
+    }
+
+    friend Concat<Allocator, Concat, char> operator+(const Concat& lhs, char rhs)
+    {
+        return { lhs.alloc, lhs, rhs };
+    }
+
+    friend Concat<Allocator, StringView, Concat> operator+(const BasicString<Allocator>& lhs, const Concat& rhs)
+    {
+        return { lhs.get_allocator(), lhs, rhs };
+    }
+
+    friend Concat<Allocator, char, Concat> operator+(char lhs, const Concat& rhs)
+    {
+        return { rhs.alloc, lhs, rhs };
+    }
+
+    template <typename L, typename R>
+    friend Concat<Allocator, Concat, Concat<Allocator, L, R>> operator+(const Concat& lhs, const Concat<Allocator, L, R>& rhs)
+    {
+        return { lhs.alloc, lhs, rhs };
+    }
+
+    friend bool operator==(const Concat& lhs, StringView rhs) noexcept
+    {
+        if (lhs.size() != rhs.size())
+            return false;
+
+        size_type offset = 0;
+        bool equal = true;
+        lhs.for_each_piece([&](StringView piece) {
+            equal = equal && std::memcmp(piece.data(), rhs.data() + offset, piece.size()) == 0;
+            offset += piece.size();
+        });
+        return equal;
+    }
+
+    friend bool operator!=(const Concat& lhs, StringView rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator==(StringView lhs, const Concat& rhs) noexcept
+    {
+        return rhs == lhs;
+    }
+
+    friend bool operator!=(StringView lhs, const Concat& rhs) noexcept
+    {
+        return !(rhs == lhs);
+    }
+
+    template <typename L, typename R>
+    friend bool operator==(const Concat& lhs, const Concat<Allocator, L, R>& rhs)
+    {
+        return lhs == StringView(rhs);
+    }
+
+    template <typename L, typename R>
+    friend bool operator!=(const Concat& lhs, const Concat<Allocator, L, R>& rhs)
+    {
+        return !(lhs == StringView(rhs));
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const Concat& concat)
+    {
+        concat.for_each_piece([&out](StringView piece) { out << piece; });
+        return out;
+    }
+
+private:
+    /* Builds the string with room for extra more characters */
+    BasicString<Allocator> build(size_type extra = 0) const
+    {
+        std::basic_string<char, std::char_traits<char>, Allocator> result(alloc);
+        result.reserve(size() + extra);
+        append_to(result);
+        return BasicString<Allocator>(std::move(result));
+    }
+
+    static size_type size_of(StringView string) noexcept
+    {
+        return string.size();
+    }
+
+    static size_type size_of(char) noexcept
+    {
+        return 1;
+    }
+
+    template <typename L, typename R>
+    static size_type size_of(const Concat<Allocator, L, R>& concat) noexcept
+    {
+        return concat.size();
+    }
+
+    template <typename F>
+    static void visit(StringView string, F& f)
+    {
+        f(string);
+    }
+
+    template <typename F>
+    static void visit(const char& c, F& f)
+    {
+        f(StringView(&c, 1));
+    }
+
+    template <typename L, typename R, typename F>
+    static void visit(const Concat<Allocator, L, R>& concat, F& f)
+    {
+        concat.for_each_piece(f);
+    }
+
+    Allocator alloc;
+    Lhs lhs;
+    Rhs rhs;
+    mutable std::basic_string<char, std::char_traits<char>, Allocator> built;
+};
+
+/* Python-like string on top of std::basic_string. The allocator is
+ * used for the string itself and for every string derived from it
+ * (slice(), copy(), split(), operator+, ...), see Arena. operator+
+ * returns a Concat expression that is built when converted. */
+template <typename Allocator = std::allocator<char>>
+struct BasicString {
+    using size_type = std::string::size_type;
+    using string_type = std::basic_string<char, std::char_traits<char>, Allocator>;
+    using vector_type = std::vector<BasicString, typename std::allocator_traits<Allocator>::template rebind_alloc<BasicString>>;
+
+    BasicString() = default;
+
+    explicit BasicString(const Allocator& alloc)
+        : str(alloc)
+    {
+    }
+
+    BasicString(string_type str)
+        : str(std::move(str))
+    {
+    }
+
+    BasicString(const char* str, const Allocator& alloc = Allocator())
+        : str(str, alloc)
+    {
+    }
+
+    explicit BasicString(StringView str, const Allocator& alloc = Allocator())
+        : str(str.data(), str.size(), alloc)
+    {
+    }
+
+    /* Builds a + b + ... with a single allocation */
+    template <typename L, typename R>
+    BasicString(const Concat<Allocator, L, R>& concat)
+        : str(concat.get_allocator())
+    {
+        str.reserve(concat.size());
+        concat.append_to(str);
+    }
+
+    Allocator get_allocator() const
+    {
+        return str.get_allocator();
+    }
+
+    operator StringView() const noexcept
+    {
+        return { str.data(), str.size() };
+    }
+
+    BasicString copy() const
+    {
+        return BasicString(string_type(str, str.get_allocator()));
+    }
+
+    size_type str_index(int rel_pos) const
+    {
+        return static_cast<size_type>(rel_pos >= 0 ? rel_pos : size() + rel_pos);
+    }
+
+    bool empty() const
+    {
+        return str.empty();
+    }
+
+    size_type size() const
+    {
+        return str.size();
+    }
+
+    size_type len() const
+    {
+        return size();
+    }
+
+    const char* c_str() const
+    {
+        return str.c_str();
+    }
+
+    char& operator[](int pos)
+    {
+        return str[str_index(pos)];
+    }
+
+    const char& operator[](int pos) const
+    {
+        return str[str_index(pos)];
+    }
+
+    const char* begin() const
+    {
+        return &str[0];
+    }
+
+    const char* end() const
+    {
+        return &str[size()];
+    }
+
+    char* begin()
+    {
+        return &str[0];
+    }
+
+    char* end()
+    {
+        return &str[size()];
+    }
+
+    /* from and to indexes are included */
+    BasicString slice(int from, int to) const
+    {
+        return BasicString(StringView(*this).slice(from, to), str.get_allocator());
+    }
+
+    BasicString operator()(int from, int to) const
+    {
+        return slice(from, to);
+    }
+
+    BasicString& operator+=(char c)
+    {
+        str += c;
+        return *this;
+    }
+
+    BasicString& operator+=(StringView string)
+    {
+        str.append(string.data(), string.size());
+        return *this;
+    }
+
+    /* Appends the operands one by one, unless one of them views this
+     * string and growing the buffer would invalidate it */
+    template <typename L, typename R>
+    BasicString& operator+=(const Concat<Allocator, L, R>& string)
+    {
+        if (string.views(begin(), end())) {
+            string_type result(str.get_allocator());
+            result.reserve(size() + string.size());
+            result.append(str);
+            string.append_to(result);
+            str = std::move(result);
+        } else {
+            str.reserve(size() + string.size());
+            string.append_to(str);
+        }
+        return *this;
+    }
+
+    BasicString& insert(int pos, char c)
+    {
+        str.insert(str_index(pos), 1, c);
+        return *this;
+    }
+
+    BasicString& insert(int pos, StringView string)
+    {
+        str.insert(str_index(pos), string.data(), string.size());
+        return *this;
+    }
+
+    /* Opens a gap once and copies the operands into it */
+    template <typename L, typename R>
+    BasicString& insert(int pos, const Concat<Allocator, L, R>& string)
+    {
+        if (string.views(begin(), end()))
+            return insert(pos, StringView(string));
+
+        auto index = str_index(pos);
+        str.insert(index, string.size(), '\0');
+        auto out = str.begin() + static_cast<std::ptrdiff_t>(index);
+        string.for_each_piece([&out](StringView piece) { out = std::copy(piece.begin(), piece.end(), out); });
+        return *this;
+    }
+
+    BasicString& del(int pos)
+    {
+        str.erase(str_index(pos), 1);
+        return *this;
+    }
+
+    BasicString& capitalize()
+    {
+        if (empty())
+            return *this;
+
+        detail::ascii_upper(begin(), begin() + 1);
+        detail::ascii_lower(begin() + 1, end());
+
+        return *this;
+    }
+
+    BasicString& casefold()
+    {
+        detail::ascii_lower(begin(), end());
+        return *this;
+    }
+
+    bool contains(StringView string) const noexcept
+    {
+        return StringView(*this).contains(string);
+    }
+
+    size_type count(StringView value, int start_pos = 0) const noexcept
+    {
+        return StringView(*this).count(value, start_pos);
+    }
+
+    bool endswith(StringView value) const noexcept
+    {
+        return StringView(*this).endswith(value);
+    }
+
+    size_type find(StringView value) const noexcept
+    {
+        return StringView(*this).find(value);
+    }
+
+    size_type index(StringView value) const noexcept
+    {
+        return find(value);
+    }
+
+    bool isalpha() const noexcept
+    {
+        return StringView(*this).isalpha();
+    }
+
+    bool isdigit() const noexcept
+    {
+        return StringView(*this).isdigit();
+    }
+
+    bool isalnum() const noexcept
+    {
+        return StringView(*this).isalnum();
+    }
+
+    bool islower() const noexcept
+    {
+        return StringView(*this).islower();
+    }
+
+    bool isupper() const noexcept
+    {
+        return StringView(*this).isupper();
+    }
+
+    bool isspace() const noexcept
+    {
+        return StringView(*this).isspace();
+    }
+
+    unsigned classify() const noexcept
+    {
+        return StringView(*this).classify();
+    }
+
+    /* Joins the characters of string, using this string as separator */
+    BasicString& join(const BasicString& string)
+    {
+        string_type result(str.get_allocator());
+        if (!string.empty())
+            result.reserve(string.size() + (string.size() - 1) * size());
+
+        for (size_type i = 0; i < string.size(); ++i) {
+            if (i)
+                result += str;
+            result += string.str[i];
+        }
+
+        str.swap(result);
+        return *this;
+    }
+
+    /* Also takes braced lists. A single element is copied as it is,
+     * like Python's str.join() and the range overload. */
+    BasicString& join(const std::vector<BasicString>& strings)
+    {
+        return join<std::vector<BasicString>>(strings);
+    }
+
+    /* Joins any range of String, StringView, std::string or const char*
+     * elements. Forward ranges are measured first, so the result is
+     * allocated once and every piece copied with a single memcpy. */
+    template <typename Range, typename = std::enable_if_t<detail::is_string_range<Range>::value>>
+    BasicString& join(const Range& strings)
+    {
+        using Iterator = decltype(std::begin(strings));
+        using Category = typename std::iterator_traits<Iterator>::iterator_category;
+
+        string_type result(str.get_allocator());
+        if (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+            size_type total = 0;
+            size_type count = 0;
+            for (const auto& string : strings) {
+                total += StringView(string).size();
+                ++count;
+            }
+            result.reserve(total + (count ? count - 1 : 0) * size());
+        }
+
+        bool first = true;
+        for (const auto& string : strings) {
+            if (!first)
+                result.append(str);
+            first = false;
+
+            StringView piece { string };
+            result.append(piece.data(), piece.size());
+        }
+
+        str.swap(result);
+        return *this;
+    }
+
+    /* Joins a random access range, copying the pieces on several threads.
+     * Each thread sums the sizes of its share, the exclusive prefix sum
+     * of those gives every thread its output offset. */
+    template <typename Range, typename = std::enable_if_t<detail::is_string_range<Range>::value>>
+    BasicString& join(const Range& strings, Parallel policy)
+    {
+        auto first = std::begin(strings);
+        auto count = static_cast<size_type>(std::distance(first, std::end(strings)));
+        auto tasks = policy.tasks(count, Parallel::Min_join_pieces);
+        if (tasks <= 1)
+            return join(strings);
+
+        auto share = [count, tasks](size_type task) { return count * task / tasks; };
+        std::vector<size_type> offsets(tasks + 1, 0);
+        detail::run_parallel(tasks, [&](size_type task) {
+            size_type bytes = 0;
+            for (auto i = share(task); i < share(task + 1); ++i)
+                bytes += StringView(first[static_cast<std::ptrdiff_t>(i)]).size() + (i ? size() : 0);
+            offsets[task + 1] = bytes;
+        });
+
+        for (size_type task = 0; task < tasks; ++task)
+            offsets[task + 1] += offsets[task];
+
+        string_type result(offsets[tasks], '\0', str.get_allocator());
+        detail::run_parallel(tasks, [&](size_type task) {
+            auto out = &result[0] + offsets[task];
+            for (auto i = share(task); i < share(task + 1); ++i) {
+                if (i) {
+                    std::memcpy(out, str.data(), size());
+                    out += size();
+                }
+                StringView piece { first[static_cast<std::ptrdiff_t>(i)] };
+                std::memcpy(out, piece.data(), piece.size());
+                out += piece.size();
+            }
+        });
+
+        str.swap(result);
+        return *this;
+    }
+
+    BasicString& lower()
+    {
+        return casefold();
+    }
+
+    /* Replaces the first count occurrences of oldvalue (all of them if
+     * count is negative). Matches are counted first, so the result is
+     * built in one pass into an exactly sized buffer, or in place when
+     * both values have the same length. */
+    BasicString& replace(StringView oldvalue, StringView newvalue, int count = -1)
+    {
+        auto limit = count < 0 ? Not_found : static_cast<size_type>(count);
+        auto haystack = std::string_view(str);
+        auto needle = std::string_view(oldvalue);
+
+        if (oldvalue.empty()) {
+            /* Python inserts newvalue before every character and at the end */
+            auto matches = std::min(limit, size() + 1);
+            if (matches == 0 || newvalue.empty())
+                return *this;
+
+            string_type result(str.get_allocator());
+            result.reserve(size() + matches * newvalue.size());
+            for (size_type i = 0; i < matches; ++i) {
+                result.append(newvalue.data(), newvalue.size());
+                if (i < size())
+                    result += str[i];
+            }
+            if (matches <= size())
+                result.append(str, matches, Not_found);
+
+            str.swap(result);
+            return *this;
+        }
+
+        size_type matches = 0;
+        for (auto pos = haystack.find(needle); pos != Not_found && matches < limit; pos = haystack.find(needle, pos + needle.size()))
+            ++matches;
+
+        if (matches == 0)
+            return *this;
+
+        auto aliases = detail::points_into(oldvalue.data(), begin(), end()) || detail::points_into(newvalue.data(), begin(), end());
+        if (oldvalue.size() == newvalue.size() && !aliases) {
+            for (auto pos = haystack.find(needle); matches--; pos = haystack.find(needle, pos + needle.size()))
+                std::memcpy(&str[pos], newvalue.data(), newvalue.size());
+
+            return *this;
+        }
+
+        string_type result(str.get_allocator());
+        result.reserve(size() - matches * oldvalue.size() + matches * newvalue.size());
+        size_type from = 0;
+        for (auto pos = haystack.find(needle); matches--; from = pos + needle.size(), pos = haystack.find(needle, from)) {
+            result.append(str, from, pos - from);
+            result.append(newvalue.data(), newvalue.size());
+        }
+        result.append(str, from, Not_found);
+
+        str.swap(result);
+        return *this;
+    }
+
+    size_type rfind(StringView value) const noexcept
+    {
+        return StringView(*this).rfind(value);
+    }
+
+    size_type rindex(StringView value) const noexcept
+    {
+        return rfind(value);
+    }
+
+    bool contains(StringView string, Parallel policy) const
+    {
+        return StringView(*this).contains(string, policy);
+    }
+
+    size_type count(StringView value, Parallel policy) const
+    {
+        return StringView(*this).count(value, policy);
+    }
+
+    size_type find(StringView value, Parallel policy) const
+    {
+        return StringView(*this).find(value, policy);
+    }
+
+    size_type rfind(StringView value, Parallel policy) const
+    {
+        return StringView(*this).rfind(value, policy);
+    }
+
+    vector_type split(int maxsplit = -1) const
+    {
+        vector_type result(str.get_allocator());
+        for (auto token : split_view(maxsplit))
+            result.emplace_back(token, str.get_allocator());
+
+        return result;
+    }
+
+    /* Python's str.split(sep), empty parts are kept */
+    vector_type split(StringView sep, int maxsplit = -1) const
+    {
+        vector_type result(str.get_allocator());
+        for (auto token : split_view(sep, maxsplit))
+            result.emplace_back(token, str.get_allocator());
+
+        return result;
+    }
+
+    vector_type rsplit(int maxsplit = -1) const
+    {
+        vector_type result(str.get_allocator());
+        detail::rsplit_whitespace(*this, maxsplit, [&](StringView token) { result.emplace_back(token, str.get_allocator()); });
+        std::reverse(result.begin(), result.end());
+
+        return result;
+    }
+
+    vector_type rsplit(StringView sep, int maxsplit = -1) const
+    {
+        vector_type result(str.get_allocator());
+        detail::rsplit_separator(*this, sep, maxsplit, [&](StringView token) { result.emplace_back(token, str.get_allocator()); });
+        std::reverse(result.begin(), result.end());
+
+        return result;
+    }
+
+    template <typename Container>
+    Container& split_to(Container& out, int maxsplit = -1) const
+    {
+        return StringView(*this).split_to(out, maxsplit);
+    }
+
+    template <typename Container>
+    Container& split_to(Container& out, StringView sep, int maxsplit = -1) const
+    {
+        return StringView(*this).split_to(out, sep, maxsplit);
+    }
+
+    template <typename Container>
+    Container& rsplit_to(Container& out, int maxsplit = -1) const
+    {
+        return StringView(*this).rsplit_to(out, maxsplit);
+    }
+
+    template <typename Container>
+    Container& rsplit_to(Container& out, StringView sep, int maxsplit = -1) const
+    {
+        return StringView(*this).rsplit_to(out, sep, maxsplit);
+    }
+
+    Partition partition(StringView sep) const
+    {
+        return StringView(*this).partition(sep);
+    }
+
+    Partition rpartition(StringView sep) const
+    {
+        return StringView(*this).rpartition(sep);
+    }
+
+    SplitView split_view(int maxsplit = -1) const noexcept
+    {
+        return StringView(*this).split_view(maxsplit);
+    }
+
+    SplitView split_view(StringView sep, int maxsplit = -1) const
+    {
+        return StringView(*this).split_view(sep, maxsplit);
+    }
+
+    LineView splitlines_view(bool keep_line_breaks = false) const noexcept
+    {
+        return StringView(*this).splitlines_view(keep_line_breaks);
+    }
+
+    std::vector<InternTable::id_type> split(InternTable& table, int maxsplit = -1) const
+    {
+        return StringView(*this).split(table, maxsplit);
+    }
+
+    std::vector<InternTable::id_type> split(InternTable& table, StringView sep, int maxsplit = -1) const
+    {
+        return StringView(*this).split(table, sep, maxsplit);
+    }
+
+    /* Splits on every line boundary of Python's str.splitlines(),
+     * see LineView */
+    vector_type splitlines(bool keep_line_breaks = false) const
+    {
+        vector_type result(str.get_allocator());
+        for (auto line : splitlines_view(keep_line_breaks))
+            result.emplace_back(line, str.get_allocator());
+
+        return result;
+    }
+
+    bool startswith(StringView value) const noexcept
+    {
+        return StringView(*this).startswith(value);
+    }
+
+    BasicString& lstrip(const char ch = ' ')
+    {
+        return lstrip(StringView(&ch, 1));
+    }
+
+    /* Stripping in place moves the remaining characters to the front,
+     * use lstripped() or stripped() for a view instead */
+    BasicString& lstrip(StringView chars)
+    {
+        auto pos = std::string_view(str).find_first_not_of(std::string_view(chars));
+        str.erase(0, pos);
+
+        return *this;
+    }
+
+    BasicString& rstrip(const char ch = ' ')
+    {
+        return rstrip(StringView(&ch, 1));
+    }
+
+    BasicString& rstrip(StringView chars)
+    {
+        auto pos = std::string_view(str).find_last_not_of(std::string_view(chars));
+        str.erase(pos == Not_found ? 0 : pos + 1);
+
+        return *this;
+    }
+
+    StringView lstripped(const char ch = ' ') const noexcept
+    {
+        return StringView(*this).lstripped(ch);
+    }
+
+    StringView lstripped(StringView chars) const noexcept
+    {
+        return StringView(*this).lstripped(chars);
+    }
+
+    StringView rstripped(const char ch = ' ') const noexcept
+    {
+        return StringView(*this).rstripped(ch);
+    }
+
+    StringView rstripped(StringView chars) const noexcept
+    {
+        return StringView(*this).rstripped(chars);
+    }
+
+    StringView stripped(const char ch = ' ') const noexcept
+    {
+        return StringView(*this).stripped(ch);
+    }
+
+    StringView stripped(StringView chars) const noexcept
+    {
+        return StringView(*this).stripped(chars);
+    }
+
+    BasicString& strip(const char ch = ' ')
+    {
+        return strip(StringView(&ch, 1));
+    }
+
+    BasicString& strip(StringView chars)
+    {
+        rstrip(chars);
+        lstrip(chars);
+
+        return *this;
+    }
+
+    BasicString& swapcase()
+    {
+        detail::ascii_swapcase(begin(), end());
+        return *this;
+    }
+
+    /* Translates every byte through the table, deleting the bytes
+     * the table deletes */
+    BasicString& translate(const Translation& table)
+    {
+        str.resize(static_cast<size_type>(table.apply(begin(), end()) - begin()));
+        return *this;
+    }
+
+    static Translation maketrans(StringView from, StringView to, StringView deletechars = {})
+    {
+        return Translation(from, to, deletechars);
+    }
+
+    BasicString& upper()
+    {
+        detail::ascii_upper(begin(), end());
+        return *this;
+    }
+
+    BasicString& zfill(size_type len)
+    {
+        if (len < size())
+            return *this;
+
+        auto sz = size();
+        str.resize(len);
+        str.replace(len - sz, sz, str.c_str(), sz);
+        for (unsigned i = 0; i < len - sz; ++i)
+            str[i] = '0';
+
+        return *this;
+    }
+
+    string_type str {};
+
+    friend Concat<Allocator, StringView, StringView> operator+(const BasicString& lhs, const BasicString& rhs)
+    {
+        return { lhs.get_allocator(), lhs, rhs };
+    }
+
+    friend Concat<Allocator, StringView, StringView> operator+(const BasicString& lhs, const std::string& rhs)
+    {
+        return { lhs.get_allocator(), lhs, rhs };
+    }
+
+    friend Concat<Allocator, StringView, char> operator+(const BasicString& lhs, char rhs)
+    {
+        return { lhs.get_allocator(), lhs, rhs };
+    }
+
+    friend Concat<Allocator, char, StringView> operator+(char lhs, const BasicString& rhs)
+    {
+        return { rhs.get_allocator(), lhs, rhs };
+    }
+
+    /* A temporary on the left is appended to in place */
+    friend BasicString operator+(BasicString&& lhs, const BasicString& rhs)
+    {
+        return std::move(lhs += rhs);
+    }
+
+    friend BasicString operator+(BasicString&& lhs, const std::string& rhs)
+    {
+        return std::move(lhs += rhs);
+    }
+
+    friend BasicString operator+(BasicString&& lhs, char rhs)
+    {
+        return std::move(lhs += rhs);
+    }
+
+    /* A temporary on the right is never viewed either, the left side
+     * is inserted in front of it */
+    friend BasicString operator+(const BasicString& lhs, BasicString&& rhs)
+    {
+        rhs.str.insert(0, lhs.str.data(), lhs.size());
+        return std::move(rhs);
+    }
+
+    friend BasicString operator+(BasicString&& lhs, BasicString&& rhs)
+    {
+        return std::move(lhs += rhs);
+    }
+
+    friend BasicString operator+(const BasicString& lhs, std::string&& rhs)
+    {
+        string_type result(lhs.get_allocator());
+        result.reserve(lhs.size() + rhs.size());
+        result.append(lhs.str).append(rhs);
+        return BasicString(std::move(result));
+    }
+
+    friend BasicString operator+(BasicString&& lhs, std::string&& rhs)
+    {
+        return std::move(lhs += rhs);
+    }
+
+    friend BasicString operator+(char lhs, BasicString&& rhs)
+    {
+        rhs.str.insert(rhs.str.begin(), lhs);
+        return std::move(rhs);
+    }
+
+    template <typename L, typename R>
+    friend BasicString operator+(BasicString&& lhs, const Concat<Allocator, L, R>& rhs)
+    {
+        return std::move(lhs += rhs);
+    }
+};
+
+using String = BasicString<>;
+using ArenaString = BasicString<ArenaAllocator<char>>;
+
+namespace pmr {
+using String = BasicString<std::pmr::polymorphic_allocator<char>>;
+}
+
+/* UTF-8 aware versions of the byte-wise String operations. The
+ * kernels run over the whole buffer with the ASCII fast paths above
+ * and only decode the code points that are not ASCII, so mostly ASCII
+ * text costs about the same as with the byte-wise methods. Invalid
+ * sequences are treated as single bytes and left unchanged. */
+namespace detail {
+inline unsigned popcount(std::uint32_t mask) noexcept
+{
+#if defined(_MSC_VER)
+    return static_cast<unsigned>(__popcnt(mask));
+#else
+    return static_cast<unsigned>(__builtin_popcount(mask));
+#endif
+}
+
+struct Non_ascii_class {
+    constexpr bool operator()(unsigned char c) const noexcept
+    {
+        return c >= 0x80;
+    }
+
+#if defined(PY_STRING_SSE2)
+    std::uint32_t mask(__m128i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(block));
+    }
+#endif
+
+#if defined(PY_STRING_AVX2)
+    std::uint32_t mask(__m256i block) const noexcept
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(block));
+    }
+#endif
+};
+
+inline const char* find_non_ascii(const char* first, const char* last) noexcept
+{
+    return find_class<false>(first, last, Non_ascii_class {});
+}
+
+/* Decodes the code point at first, returns its length in bytes, or 0
+ * when the sequence is not valid UTF-8 */
+inline unsigned decode_utf8(const char* first, const char* last, char32_t& code_point) noexcept
+{
+    auto byte = [first](int i) { return static_cast<unsigned char>(first[i]); };
+    auto continuation = [&](int i) { return first + i < last && (byte(i) & 0xc0) == 0x80; };
+
+    auto lead = byte(0);
+    if (lead < 0x80) {
+        code_point = lead;
+        return 1;
+    }
+    if (lead >= 0xc2 && lead <= 0xdf && continuation(1)) {
+        code_point = static_cast<char32_t>((lead & 0x1f) << 6 | (byte(1) & 0x3f));
+        return 2;
+    }
+    if (lead >= 0xe0 && lead <= 0xef && continuation(1) && continuation(2)) {
+        code_point = static_cast<char32_t>((lead & 0x0f) << 12 | (byte(1) & 0x3f) << 6 | (byte(2) & 0x3f));
+        return code_point >= 0x800 && (code_point < 0xd800 || code_point > 0xdfff) ? 3 : 0;
+    }
+    if (lead >= 0xf0 && lead <= 0xf4 && continuation(1) && continuation(2) && continuation(3)) {
+        code_point = static_cast<char32_t>((lead & 0x07) << 18 | (byte(1) & 0x3f) << 12 | (byte(2) & 0x3f) << 6 | (byte(3) & 0x3f));
+        return code_point >= 0x10000 && code_point <= 0x10ffff ? 4 : 0;
+    }
+
+    return 0;
+}
+
+/* Writes the encoding of code_point to out, returns its length */
+inline unsigned encode_utf8(char32_t code_point, char* out) noexcept
+{
+    if (code_point < 0x80) {
+        out[0] = static_cast<char>(code_point);
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = static_cast<char>(0xc0 | code_point >> 6);
+        out[1] = static_cast<char>(0x80 | (code_point & 0x3f));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = static_cast<char>(0xe0 | code_point >> 12);
+        out[1] = static_cast<char>(0x80 | (code_point >> 6 & 0x3f));
+        out[2] = static_cast<char>(0x80 | (code_point & 0x3f));
+        return 3;
+    }
+
+    out[0] = static_cast<char>(0xf0 | code_point >> 18);
+    out[1] = static_cast<char>(0x80 | (code_point >> 12 & 0x3f));
+    out[2] = static_cast<char>(0x80 | (code_point >> 6 & 0x3f));
+    out[3] = static_cast<char>(0x80 | (code_point & 0x3f));
+    return 4;
+}
+
+/* Byte-wise validation, used when SSSE3 is not available */
+inline bool valid_utf8_scalar(const char* first, const char* last) noexcept
+{
+    while (first != last) {
+        first = find_non_ascii(first, last);
+        if (first == last)
+            return true;
+
+        char32_t code_point;
+        auto length = decode_utf8(first, last, code_point);
+        if (!length)
+            return false;
+        first += length;
+    }
+
+    return true;
+}
+
+#if defined(PY_STRING_SSSE3)
+/* Vector operations for Utf8_validator, on 16 or 32 bytes */
+struct Sse_ops {
+    using vector = __m128i;
+    static constexpr int width = 16;
+
+    static vector load(const char* ptr) noexcept { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)); }
+    static vector zero() noexcept { return _mm_setzero_si128(); }
+    static vector table(const std::uint8_t (&t)[16]) noexcept { return load(reinterpret_cast<const char*>(t)); }
+    static vector lookup(vector table, vector index) noexcept { return _mm_shuffle_epi8(table, index); }
+    static vector high_nibbles(vector v) noexcept { return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)); }
+    static vector low_nibbles(vector v) noexcept { return _mm_and_si128(v, _mm_set1_epi8(0x0f)); }
+    static vector and_(vector a, vector b) noexcept { return _mm_and_si128(a, b); }
+    static vector or_(vector a, vector b) noexcept { return _mm_or_si128(a, b); }
+    static vector xor_(vector a, vector b) noexcept { return _mm_xor_si128(a, b); }
+    static vector saturating_sub(vector v, std::uint8_t n) noexcept { return _mm_subs_epu8(v, _mm_set1_epi8(static_cast<char>(n))); }
+    static vector saturating_sub(vector a, vector b) noexcept { return _mm_subs_epu8(a, b); }
+    static vector high_bits(vector v) noexcept { return _mm_and_si128(v, _mm_set1_epi8(static_cast<char>(0x80))); }
+    static bool is_ascii(vector v) noexcept { return _mm_movemask_epi8(v) == 0; }
+    static bool any(vector v) noexcept { return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff; }
+
+    /* The vector shifted up by N bytes, filled in from the end of before */
+    template <int N>
+    static vector prev(vector v, vector before) noexcept
+    {
+        return _mm_alignr_epi8(v, before, 16 - N);
+    }
+};
+#endif
+
+#if defined(PY_STRING_AVX2)
+struct Avx2_ops {
+    using vector = __m256i;
+    static constexpr int width = 32;
+
+    static vector load(const char* ptr) noexcept { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); }
+    static vector zero() noexcept { return _mm256_setzero_si256(); }
+    static vector table(const std::uint8_t (&t)[16]) noexcept { return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t))); }
+    static vector lookup(vector table, vector index) noexcept { return _mm256_shuffle_epi8(table, index); }
+    static vector high_nibbles(vector v) noexcept { return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f)); }
+    static vector low_nibbles(vector v) noexcept { return _mm256_and_si256(v, _mm256_set1_epi8(0x0f)); }
+    static vector and_(vector a, vector b) noexcept { return _mm256_and_si256(a, b); }
+    static vector or_(vector a, vector b) noexcept { return _mm256_or_si256(a, b); }
+    static vector xor_(vector a, vector b) noexcept { return _mm256_xor_si256(a, b); }
+    static vector saturating_sub(vector v, std::uint8_t n) noexcept { return _mm256_subs_epu8(v, _mm256_set1_epi8(static_cast<char>(n))); }
+    static vector saturating_sub(vector a, vector b) noexcept { return _mm256_subs_epu8(a, b); }
+    static vector high_bits(vector v) noexcept { return _mm256_and_si256(v, _mm256_set1_epi8(static_cast<char>(0x80))); }
+    static bool is_ascii(vector v) noexcept { return _mm256_movemask_epi8(v) == 0; }
+    static bool any(vector v) noexcept { return !_mm256_testz_si256(v, v); }
+
+    template <int N>
+    static vector prev(vector v, vector before) noexcept
+    {
+        return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(before, v, 0x21), 16 - N);
+    }
+};
+#endif
+
+#if defined(PY_STRING_SSSE3)
+/* Lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less
+ * Than One Instruction Per Byte": the high and low nibble of every
+ * byte and the high nibble of the byte after it are looked up in three
+ * tables of error bits, and an error remains where all three agree.
+ * Three and four byte sequences are checked with the two and three
+ * bytes before each continuation. Blocks of pure ASCII only check that
+ * no sequence was left incomplete before them. */
+template <typename Ops>
+class Utf8_validator {
+public:
+    using vector = typename Ops::vector;
+
+    void add(vector block) noexcept
+    {
+        if (Ops::is_ascii(block)) {
+            error = Ops::or_(error, incomplete);
+            incomplete = Ops::zero();
+            previous = Ops::zero();
+            return;
+        }
+
+        auto prev1 = Ops::template prev<1>(block, previous);
+        auto special = Ops::and_(Ops::and_(Ops::lookup(Ops::table(byte_1_high), Ops::high_nibbles(prev1)), Ops::lookup(Ops::table(byte_1_low), Ops::low_nibbles(prev1))),
+            Ops::lookup(Ops::table(byte_2_high), Ops::high_nibbles(block)));
+
+        /* Continuations that have to follow a three or four byte lead */
+        auto third = Ops::saturating_sub(Ops::template prev<2>(block, previous), 0xe0 - 0x80);
+        auto fourth = Ops::saturating_sub(Ops::template prev<3>(block, previous), 0xf0 - 0x80);
+        auto must_continue = Ops::high_bits(Ops::or_(third, fourth));
+        error = Ops::or_(error, Ops::xor_(must_continue, special));
+
+        incomplete = Ops::saturating_sub(block, Ops::load(reinterpret_cast<const char*>(incomplete_limits + 32 - Ops::width)));
+        previous = block;
+    }
+
+    bool valid() const noexcept
+    {
+        return !Ops::any(Ops::or_(error, incomplete));
+    }
+
+private:
+    static constexpr std::uint8_t Too_short = 1 << 0;
+    static constexpr std::uint8_t Too_long = 1 << 1;
+    static constexpr std::uint8_t Overlong_3 = 1 << 2;
+    static constexpr std::uint8_t Too_large = 1 << 3;
+    static constexpr std::uint8_t Surrogate = 1 << 4;
+    static constexpr std::uint8_t Overlong_2 = 1 << 5;
+    static constexpr std::uint8_t Too_large_1000 = 1 << 6;
+    static constexpr std::uint8_t Overlong_4 = 1 << 6;
+    static constexpr std::uint8_t Two_conts = 1 << 7;
+    static constexpr std::uint8_t Carry = Too_short | Too_long | Two_conts;
+
+    static constexpr std::uint8_t byte_1_high[16] = {
+        Too_long, Too_long, Too_long, Too_long, Too_long, Too_long, Too_long, Too_long,
+        Two_conts, Two_conts, Two_conts, Two_conts,
+        Too_short | Overlong_2,
+        Too_short,
+        Too_short | Overlong_3 | Surrogate,
+        Too_short | Too_large | Too_large_1000 | Overlong_4
+    };
+
+    static constexpr std::uint8_t byte_1_low[16] = {
+        Carry | Overlong_3 | Overlong_2 | Overlong_4,
+        Carry | Overlong_2,
+        Carry,
+        Carry,
+        Carry | Too_large,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000 | Surrogate,
+        Carry | Too_large | Too_large_1000,
+        Carry | Too_large | Too_large_1000
+    };
+
+    static constexpr std::uint8_t byte_2_high[16] = {
+        Too_short, Too_short, Too_short, Too_short, Too_short, Too_short, Too_short, Too_short,
+        Too_long | Overlong_2 | Two_conts | Overlong_3 | Too_large_1000 | Overlong_4,
+        Too_long | Overlong_2 | Two_conts | Overlong_3 | Too_large,
+        Too_long | Overlong_2 | Two_conts | Surrogate | Too_large,
+        Too_long | Overlong_2 | Two_conts | Surrogate | Too_large,
+        Too_short, Too_short, Too_short, Too_short
+    };
+
+    /* A lead byte in the last three bytes of a block needs the next one */
+    static constexpr std::uint8_t incomplete_limits[32] = {
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+    };
+
+    vector error = Ops::zero();
+    vector incomplete = Ops::zero();
+    vector previous = Ops::zero();
+};
+
+template <typename Ops>
+bool valid_utf8_simd(const char* first, const char* last) noexcept
+{
+    Utf8_validator<Ops> validator;
+    for (; last - first >= Ops::width; first += Ops::width)
+        validator.add(Ops::load(first));
+
+    /* The tail is padded with ASCII, which ends any open sequence */
+    if (first != last) {
+        char tail[Ops::width] = {};
+        std::memcpy(tail, first, static_cast<std::size_t>(last - first));
+        validator.add(Ops::load(tail));
+    }
+
+    return validator.valid();
+}
+#endif
+
+inline bool valid_utf8(const char* first, const char* last) noexcept
+{
+    first = find_non_ascii(first, last);
+#if defined(PY_STRING_AVX2)
+    return valid_utf8_simd<Avx2_ops>(first, last);
+#elif defined(PY_STRING_SSSE3)
+    return valid_utf8_simd<Sse_ops>(first, last);
+#else
+    return valid_utf8_scalar(first, last);
+#endif
+}
+
+/* Code points are the bytes that are not continuation bytes, which
+ * are the bytes below -64 when read as signed */
+inline std::size_t count_code_points(const char* first, const char* last) noexcept
+{
+    std::size_t count = 0;
+
+#if defined(PY_STRING_AVX2)
+    for (; last - first >= 32; first += 32) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        count += popcount(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(-65)))));
+    }
+#endif
+
+#if defined(PY_STRING_SSE2)
+    for (; last - first >= 16; first += 16) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        count += popcount(static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(block, _mm_set1_epi8(-65)))));
+    }
+#endif
+
+    for (; first != last; ++first)
+        count += (static_cast<unsigned char>(*first) & 0xc0) != 0x80;
+
+    return count;
+}
+
+/* Simple (one to one) case mappings and case folding of UnicodeData.txt
+ * and CaseFolding.txt. Every range maps the code points first,
+ * first + step, ..., last by adding delta. Mappings whose result is
+ * longer in UTF-8 are left out (for example U+023A to U+2C65), so case
+ * mapping can be done in place. The ranges are sorted and do not
+ * overlap. */
+struct Case_range {
+    char32_t first;
+    char32_t last;
+    std::int32_t delta;
+    std::uint8_t step;
+};
+
+/* BEGIN case tables, generated by tools/gen_case_table.py */
+inline constexpr Case_range lower_ranges[] = {
+    { 0x00c0, 0x00d6, 32, 1 },
+    { 0x00d8, 0x00de, 32, 1 },
+    { 0x0100, 0x012e, 1, 2 },
+    { 0x0130, 0x0130, -199, 1 },
+    { 0x0132, 0x0136, 1, 2 },
+    { 0x0139, 0x0147, 1, 2 },
+    { 0x014a, 0x0176, 1, 2 },
+    { 0x0178, 0x0178, -121, 1 },
+    { 0x0179, 0x017d, 1, 2 },
+    { 0x0181, 0x0181, 210, 1 },
+    { 0x0182, 0x0184, 1, 2 },
+    { 0x0186, 0x0186, 206, 1 },
+    { 0x0187, 0x0187, 1, 1 },
+    { 0x0189, 0x018a, 205, 1 },
+    { 0x018b, 0x018b, 1, 1 },
+    { 0x018e, 0x018e, 79, 1 },
+    { 0x018f, 0x018f, 202, 1 },
+    { 0x0190, 0x0190, 203, 1 },
+    { 0x0191, 0x0191, 1, 1 },
+    { 0x0193, 0x0193, 205, 1 },
+    { 0x0194, 0x0194, 207, 1 },
+    { 0x0196, 0x0196, 211, 1 },
+    { 0x0197, 0x0197, 209, 1 },
+    { 0x0198, 0x0198, 1, 1 },
+    { 0x019c, 0x019c, 211, 1 },
+    { 0x019d, 0x019d, 213, 1 },
+    { 0x019f, 0x019f, 214, 1 },
+    { 0x01a0, 0x01a4, 1, 2 },
+    { 0x01a6, 0x01a6, 218, 1 },
+    { 0x01a7, 0x01a7, 1, 1 },
+    { 0x01a9, 0x01a9, 218, 1 },
+    { 0x01ac, 0x01ac, 1, 1 },
+    { 0x01ae, 0x01ae, 218, 1 },
+    { 0x01af, 0x01af, 1, 1 },
+    { 0x01b1, 0x01b2, 217, 1 },
+    { 0x01b3, 0x01b5, 1, 2 },
+    { 0x01b7, 0x01b7, 219, 1 },
+    { 0x01b8, 0x01bc, 1, 4 },
+    { 0x01c4, 0x01c4, 2, 1 },
+    { 0x01c5, 0x01c5, 1, 1 },
+    { 0x01c7, 0x01c7, 2, 1 },
+    { 0x01c8, 0x01c8, 1, 1 },
+    { 0x01ca, 0x01ca, 2, 1 },
+    { 0x01cb, 0x01db, 1, 2 },
+    { 0x01de, 0x01ee, 1, 2 },
+    { 0x01f1, 0x01f1, 2, 1 },
+    { 0x01f2, 0x01f4, 1, 2 },
+    { 0x01f6, 0x01f6, -97, 1 },
+    { 0x01f7, 0x01f7, -56, 1 },
+    { 0x01f8, 0x021e, 1, 2 },
+    { 0x0220, 0x0220, -130, 1 },
+    { 0x0222, 0x0232, 1, 2 },
+    { 0x023b, 0x023b, 1, 1 },
+    { 0x023d, 0x023d, -163, 1 },
+    { 0x0241, 0x0241, 1, 1 },
+    { 0x0243, 0x0243, -195, 1 },
+    { 0x0244, 0x0244, 69, 1 },
+    { 0x0245, 0x0245, 71, 1 },
+    { 0x0246, 0x024e, 1, 2 },
+    { 0x0370, 0x0372, 1, 2 },
+    { 0x0376, 0x0376, 1, 1 },
+    { 0x037f, 0x037f, 116, 1 },
+    { 0x0386, 0x0386, 38, 1 },
+    { 0x0388, 0x038a, 37, 1 },
+    { 0x038c, 0x038c, 64, 1 },
+    { 0x038e, 0x038f, 63, 1 },
+    { 0x0391, 0x03a1, 32, 1 },
+    { 0x03a3, 0x03ab, 32, 1 },
+    { 0x03cf, 0x03cf, 8, 1 },
+    { 0x03d8, 0x03ee, 1, 2 },
+    { 0x03f4, 0x03f4, -60, 1 },
+    { 0x03f7, 0x03f7, 1, 1 },
+    { 0x03f9, 0x03f9, -7, 1 },
+    { 0x03fa, 0x03fa, 1, 1 },
+    { 0x03fd, 0x03ff, -130, 1 },
+    { 0x0400, 0x040f, 80, 1 },
+    { 0x0410, 0x042f, 32, 1 },
+    { 0x0460, 0x0480, 1, 2 },
+    { 0x048a, 0x04be, 1, 2 },
+    { 0x04c0, 0x04c0, 15, 1 },
+    { 0x04c1, 0x04cd, 1, 2 },
+    { 0x04d0, 0x052e, 1, 2 },
+    { 0x0531, 0x0556, 48, 1 },
+    { 0x10a0, 0x10c5, 7264, 1 },
+    { 0x10c7, 0x10cd, 7264, 6 },
+    { 0x13a0, 0x13ef, 38864, 1 },
+    { 0x13f0, 0x13f5, 8, 1 },
+    { 0x1c90, 0x1cba, -3008, 1 },
+    { 0x1cbd, 0x1cbf, -3008, 1 },
+    { 0x1e00, 0x1e94, 1, 2 },
+    { 0x1e9e, 0x1e9e, -7615, 1 },
+    { 0x1ea0, 0x1efe, 1, 2 },
+    { 0x1f08, 0x1f0f, -8, 1 },
+    { 0x1f18, 0x1f1d, -8, 1 },
+    { 0x1f28, 0x1f2f, -8, 1 },
+    { 0x1f38, 0x1f3f, -8, 1 },
+    { 0x1f48, 0x1f4d, -8, 1 },
+    { 0x1f59, 0x1f5f, -8, 2 },
+    { 0x1f68, 0x1f6f, -8, 1 },
+    { 0x1f88, 0x1f8f, -8, 1 },
+    { 0x1f98, 0x1f9f, -8, 1 },
+    { 0x1fa8, 0x1faf, -8, 1 },
+    { 0x1fb8, 0x1fb9, -8, 1 },
+    { 0x1fba, 0x1fbb, -74, 1 },
+    { 0x1fbc, 0x1fbc, -9, 1 },
+    { 0x1fc8, 0x1fcb, -86, 1 },
+    { 0x1fcc, 0x1fcc, -9, 1 },
+    { 0x1fd8, 0x1fd9, -8, 1 },
+    { 0x1fda, 0x1fdb, -100, 1 },
+    { 0x1fe8, 0x1fe9, -8, 1 },
+    { 0x1fea, 0x1feb, -112, 1 },
+    { 0x1fec, 0x1fec, -7, 1 },
+    { 0x1ff8, 0x1ff9, -128, 1 },
+    { 0x1ffa, 0x1ffb, -126, 1 },
+    { 0x1ffc, 0x1ffc, -9, 1 },
+    { 0x2126, 0x2126, -7517, 1 },
+    { 0x212a, 0x212a, -8383, 1 },
+    { 0x212b, 0x212b, -8262, 1 },
+    { 0x2132, 0x2132, 28, 1 },
+    { 0x2160, 0x216f, 16, 1 },
+    { 0x2183, 0x2183, 1, 1 },
+    { 0x24b6, 0x24cf, 26, 1 },
+    { 0x2c00, 0x2c2f, 48, 1 },
+    { 0x2c60, 0x2c60, 1, 1 },
+    { 0x2c62, 0x2c62, -10743, 1 },
+    { 0x2c63, 0x2c63, -3814, 1 },
+    { 0x2c64, 0x2c64, -10727, 1 },
+    { 0x2c67, 0x2c6b, 1, 2 },
+    { 0x2c6d, 0x2c6d, -10780, 1 },
+    { 0x2c6e, 0x2c6e, -10749, 1 },
+    { 0x2c6f, 0x2c6f, -10783, 1 },
+    { 0x2c70, 0x2c70, -10782, 1 },
+    { 0x2c72, 0x2c75, 1, 3 },
+    { 0x2c7e, 0x2c7f, -10815, 1 },
+    { 0x2c80, 0x2ce2, 1, 2 },
+    { 0x2ceb, 0x2ced, 1, 2 },
+    { 0x2cf2, 0x2cf2, 1, 1 },
+    { 0xa640, 0xa66c, 1, 2 },
+    { 0xa680, 0xa69a, 1, 2 },
+    { 0xa722, 0xa72e, 1, 2 },
+    { 0xa732, 0xa76e, 1, 2 },
+    { 0xa779, 0xa77b, 1, 2 },
+    { 0xa77d, 0xa77d, -35332, 1 },
+    { 0xa77e, 0xa786, 1, 2 },
+    { 0xa78b, 0xa78b, 1, 1 },
+    { 0xa78d, 0xa78d, -42280, 1 },
+    { 0xa790, 0xa792, 1, 2 },
+    { 0xa796, 0xa7a8, 1, 2 },
+    { 0xa7aa, 0xa7aa, -42308, 1 },
+    { 0xa7ab, 0xa7ab, -42319, 1 },
+    { 0xa7ac, 0xa7ac, -42315, 1 },
+    { 0xa7ad, 0xa7ad, -42305, 1 },
+    { 0xa7ae, 0xa7ae, -42308, 1 },
+    { 0xa7b0, 0xa7b0, -42258, 1 },
+    { 0xa7b1, 0xa7b1, -42282, 1 },
+    { 0xa7b2, 0xa7b2, -42261, 1 },
+    { 0xa7b3, 0xa7b3, 928, 1 },
+    { 0xa7b4, 0xa7c2, 1, 2 },
+    { 0xa7c4, 0xa7c4, -48, 1 },
+    { 0xa7c5, 0xa7c5, -42307, 1 },
+    { 0xa7c6, 0xa7c6, -35384, 1 },
+    { 0xa7c7, 0xa7c9, 1, 2 },
+    { 0xa7d0, 0xa7d6, 1, 6 },
+    { 0xa7d8, 0xa7f5, 1, 29 },
+    { 0xff21, 0xff3a, 32, 1 },
+    { 0x10400, 0x10427, 40, 1 },
+    { 0x104b0, 0x104d3, 40, 1 },
+    { 0x10570, 0x1057a, 39, 1 },
+    { 0x1057c, 0x1058a, 39, 1 },
+    { 0x1058c, 0x10592, 39, 1 },
+    { 0x10594, 0x10595, 39, 1 },
+    { 0x10c80, 0x10cb2, 64, 1 },
+    { 0x118a0, 0x118bf, 32, 1 },
+    { 0x16e40, 0x16e5f, 32, 1 },
+    { 0x1e900, 0x1e921, 34, 1 },
+};
+
+inline constexpr Case_range upper_ranges[] = {
+    { 0x00b5, 0x00b5, 743, 1 },
+    { 0x00e0, 0x00f6, -32, 1 },
+    { 0x00f8, 0x00fe, -32, 1 },
+    { 0x00ff, 0x00ff, 121, 1 },
+    { 0x0101, 0x012f, -1, 2 },
+    { 0x0131, 0x0131, -232, 1 },
+    { 0x0133, 0x0137, -1, 2 },
+    { 0x013a, 0x0148, -1, 2 },
+    { 0x014b, 0x0177, -1, 2 },
+    { 0x017a, 0x017e, -1, 2 },
+    { 0x017f, 0x017f, -300, 1 },
+    { 0x0180, 0x0180, 195, 1 },
+    { 0x0183, 0x0185, -1, 2 },
+    { 0x0188, 0x018c, -1, 4 },
+    { 0x0192, 0x0192, -1, 1 },
+    { 0x0195, 0x0195, 97, 1 },
+    { 0x0199, 0x0199, -1, 1 },
+    { 0x019a, 0x019a, 163, 1 },
+    { 0x019e, 0x019e, 130, 1 },
+    { 0x01a1, 0x01a5, -1, 2 },
+    { 0x01a8, 0x01ad, -1, 5 },
+    { 0x01b0, 0x01b4, -1, 4 },
+    { 0x01b6, 0x01b9, -1, 3 },
+    { 0x01bd, 0x01bd, -1, 1 },
+    { 0x01bf, 0x01bf, 56, 1 },
+    { 0x01c5, 0x01c5, -1, 1 },
+    { 0x01c6, 0x01c6, -2, 1 },
+    { 0x01c8, 0x01c8, -1, 1 },
+    { 0x01c9, 0x01c9, -2, 1 },
+    { 0x01cb, 0x01cb, -1, 1 },
+    { 0x01cc, 0x01cc, -2, 1 },
+    { 0x01ce, 0x01dc, -1, 2 },
+    { 0x01dd, 0x01dd, -79, 1 },
+    { 0x01df, 0x01ef, -1, 2 },
+    { 0x01f2, 0x01f2, -1, 1 },
+    { 0x01f3, 0x01f3, -2, 1 },
+    { 0x01f5, 0x01f9, -1, 4 },
+    { 0x01fb, 0x021f, -1, 2 },
+    { 0x0223, 0x0233, -1, 2 },
+    { 0x023c, 0x0242, -1, 6 },
+    { 0x0247, 0x024f, -1, 2 },
+    { 0x0253, 0x0253, -210, 1 },
+    { 0x0254, 0x0254, -206, 1 },
+    { 0x0256, 0x0257, -205, 1 },
+    { 0x0259, 0x0259, -202, 1 },
+    { 0x025b, 0x025b, -203, 1 },
+    { 0x0260, 0x0260, -205, 1 },
+    { 0x0263, 0x0263, -207, 1 },
+    { 0x0268, 0x0268, -209, 1 },
+    { 0x0269, 0x026f, -211, 6 },
+    { 0x0272, 0x0272, -213, 1 },
+    { 0x0275, 0x0275, -214, 1 },
+    { 0x0280, 0x0283, -218, 3 },
+    { 0x0288, 0x0288, -218, 1 },
+    { 0x0289, 0x0289, -69, 1 },
+    { 0x028a, 0x028b, -217, 1 },
+    { 0x028c, 0x028c, -71, 1 },
+    { 0x0292, 0x0292, -219, 1 },
+    { 0x0345, 0x0345, 84, 1 },
+    { 0x0371, 0x0373, -1, 2 },
+    { 0x0377, 0x0377, -1, 1 },
+    { 0x037b, 0x037d, 130, 1 },
+    { 0x03ac, 0x03ac, -38, 1 },
+    { 0x03ad, 0x03af, -37, 1 },
+    { 0x03b1, 0x03c1, -32, 1 },
+    { 0x03c2, 0x03c2, -31, 1 },
+    { 0x03c3, 0x03cb, -32, 1 },
+    { 0x03cc, 0x03cc, -64, 1 },
+    { 0x03cd, 0x03ce, -63, 1 },
+    { 0x03d0, 0x03d0, -62, 1 },
+    { 0x03d1, 0x03d1, -57, 1 },
+    { 0x03d5, 0x03d5, -47, 1 },
+    { 0x03d6, 0x03d6, -54, 1 },
+    { 0x03d7, 0x03d7, -8, 1 },
+    { 0x03d9, 0x03ef, -1, 2 },
+    { 0x03f0, 0x03f0, -86, 1 },
+    { 0x03f1, 0x03f1, -80, 1 },
+    { 0x03f2, 0x03f2, 7, 1 },
+    { 0x03f3, 0x03f3, -116, 1 },
+    { 0x03f5, 0x03f5, -96, 1 },
+    { 0x03f8, 0x03fb, -1, 3 },
+    { 0x0430, 0x044f, -32, 1 },
+    { 0x0450, 0x045f, -80, 1 },
+    { 0x0461, 0x0481, -1, 2 },
+    { 0x048b, 0x04bf, -1, 2 },
+    { 0x04c2, 0x04ce, -1, 2 },
+    { 0x04cf, 0x04cf, -15, 1 },
+    { 0x04d1, 0x052f, -1, 2 },
+    { 0x0561, 0x0586, -48, 1 },
+    { 0x10d0, 0x10fa, 3008, 1 },
+    { 0x10fd, 0x10ff, 3008, 1 },
+    { 0x13f8, 0x13fd, -8, 1 },
+    { 0x1c80, 0x1c80, -6254, 1 },
+    { 0x1c81, 0x1c81, -6253, 1 },
+    { 0x1c82, 0x1c82, -6244, 1 },
+    { 0x1c83, 0x1c84, -6242, 1 },
+    { 0x1c85, 0x1c85, -6243, 1 },
+    { 0x1c86, 0x1c86, -6236, 1 },
+    { 0x1c87, 0x1c87, -6181, 1 },
+    { 0x1c88, 0x1c88, 35266, 1 },
+    { 0x1d79, 0x1d79, 35332, 1 },
+    { 0x1d7d, 0x1d7d, 3814, 1 },
+    { 0x1d8e, 0x1d8e, 35384, 1 },
+    { 0x1e01, 0x1e95, -1, 2 },
+    { 0x1e9b, 0x1e9b, -59, 1 },
+    { 0x1ea1, 0x1eff, -1, 2 },
+    { 0x1f00, 0x1f07, 8, 1 },
+    { 0x1f10, 0x1f15, 8, 1 },
+    { 0x1f20, 0x1f27, 8, 1 },
+    { 0x1f30, 0x1f37, 8, 1 },
+    { 0x1f40, 0x1f45, 8, 1 },
+    { 0x1f51, 0x1f57, 8, 2 },
+    { 0x1f60, 0x1f67, 8, 1 },
+    { 0x1f70, 0x1f71, 74, 1 },
+    { 0x1f72, 0x1f75, 86, 1 },
+    { 0x1f76, 0x1f77, 100, 1 },
+    { 0x1f78, 0x1f79, 128, 1 },
+    { 0x1f7a, 0x1f7b, 112, 1 },
+    { 0x1f7c, 0x1f7d, 126, 1 },
+    { 0x1f80, 0x1f87, 8, 1 },
+    { 0x1f90, 0x1f97, 8, 1 },
+    { 0x1fa0, 0x1fa7, 8, 1 },
+    { 0x1fb0, 0x1fb1, 8, 1 },
+    { 0x1fb3, 0x1fb3, 9, 1 },
+    { 0x1fbe, 0x1fbe, -7205, 1 },
+    { 0x1fc3, 0x1fc3, 9, 1 },
+    { 0x1fd0, 0x1fd1, 8, 1 },
+    { 0x1fe0, 0x1fe1, 8, 1 },
+    { 0x1fe5, 0x1fe5, 7, 1 },
+    { 0x1ff3, 0x1ff3, 9, 1 },
+    { 0x214e, 0x214e, -28, 1 },
+    { 0x2170, 0x217f, -16, 1 },
+    { 0x2184, 0x2184, -1, 1 },
+    { 0x24d0, 0x24e9, -26, 1 },
+    { 0x2c30, 0x2c5f, -48, 1 },
+    { 0x2c61, 0x2c61, -1, 1 },
+    { 0x2c65, 0x2c65, -10795, 1 },
+    { 0x2c66, 0x2c66, -10792, 1 },
+    { 0x2c68, 0x2c6c, -1, 2 },
+    { 0x2c73, 0x2c76, -1, 3 },
+    { 0x2c81, 0x2ce3, -1, 2 },
+    { 0x2cec, 0x2cee, -1, 2 },
+    { 0x2cf3, 0x2cf3, -1, 1 },
+    { 0x2d00, 0x2d25, -7264, 1 },
+    { 0x2d27, 0x2d2d, -7264, 6 },
+    { 0xa641, 0xa66d, -1, 2 },
+    { 0xa681, 0xa69b, -1, 2 },
+    { 0xa723, 0xa72f, -1, 2 },
+    { 0xa733, 0xa76f, -1, 2 },
+    { 0xa77a, 0xa77c, -1, 2 },
+    { 0xa77f, 0xa787, -1, 2 },
+    { 0xa78c, 0xa791, -1, 5 },
+    { 0xa793, 0xa793, -1, 1 },
+    { 0xa794, 0xa794, 48, 1 },
+    { 0xa797, 0xa7a9, -1, 2 },
+    { 0xa7b5, 0xa7c3, -1, 2 },
+    { 0xa7c8, 0xa7ca, -1, 2 },
+    { 0xa7d1, 0xa7d7, -1, 6 },
+    { 0xa7d9, 0xa7f6, -1, 29 },
+    { 0xab53, 0xab53, -928, 1 },
+    { 0xab70, 0xabbf, -38864, 1 },
+    { 0xff41, 0xff5a, -32, 1 },
+    { 0x10428, 0x1044f, -40, 1 },
+    { 0x104d8, 0x104fb, -40, 1 },
+    { 0x10597, 0x105a1, -39, 1 },
+    { 0x105a3, 0x105b1, -39, 1 },
+    { 0x105b3, 0x105b9, -39, 1 },
+    { 0x105bb, 0x105bc, -39, 1 },
+    { 0x10cc0, 0x10cf2, -64, 1 },
+    { 0x118c0, 0x118df, -32, 1 },
+    { 0x16e60, 0x16e7f, -32, 1 },
+    { 0x1e922, 0x1e943, -34, 1 },
+};
+
+inline constexpr Case_range fold_ranges[] = {
+    { 0x00b5, 0x00b5, 775, 1 },
+    { 0x00c0, 0x00d6, 32, 1 },
+    { 0x00d8, 0x00de, 32, 1 },
+    { 0x0100, 0x012e, 1, 2 },
+    { 0x0132, 0x0136, 1, 2 },
+    { 0x0139, 0x0147, 1, 2 },
+    { 0x014a, 0x0176, 1, 2 },
+    { 0x0178, 0x0178, -121, 1 },
+    { 0x0179, 0x017d, 1, 2 },
+    { 0x017f, 0x017f, -268, 1 },
+    { 0x0181, 0x0181, 210, 1 },
+    { 0x0182, 0x0184, 1, 2 },
+    { 0x0186, 0x0186, 206, 1 },
+    { 0x0187, 0x0187, 1, 1 },
+    { 0x0189, 0x018a, 205, 1 },
+    { 0x018b, 0x018b, 1, 1 },
+    { 0x018e, 0x018e, 79, 1 },
+    { 0x018f, 0x018f, 202, 1 },
+    { 0x0190, 0x0190, 203, 1 },
+    { 0x0191, 0x0191, 1, 1 },
+    { 0x0193, 0x0193, 205, 1 },
+    { 0x0194, 0x0194, 207, 1 },
+    { 0x0196, 0x0196, 211, 1 },
+    { 0x0197, 0x0197, 209, 1 },
+    { 0x0198, 0x0198, 1, 1 },
+    { 0x019c, 0x019c, 211, 1 },
+    { 0x019d, 0x019d, 213, 1 },
+    { 0x019f, 0x019f, 214, 1 },
+    { 0x01a0, 0x01a4, 1, 2 },
+    { 0x01a6, 0x01a6, 218, 1 },
+    { 0x01a7, 0x01a7, 1, 1 },
+    { 0x01a9, 0x01a9, 218, 1 },
+    { 0x01ac, 0x01ac, 1, 1 },
+    { 0x01ae, 0x01ae, 218, 1 },
+    { 0x01af, 0x01af, 1, 1 },
+    { 0x01b1, 0x01b2, 217, 1 },
+    { 0x01b3, 0x01b5, 1, 2 },
+    { 0x01b7, 0x01b7, 219, 1 },
+    { 0x01b8, 0x01bc, 1, 4 },
+    { 0x01c4, 0x01c4, 2, 1 },
+    { 0x01c5, 0x01c5, 1, 1 },
+    { 0x01c7, 0x01c7, 2, 1 },
+    { 0x01c8, 0x01c8, 1, 1 },
+    { 0x01ca, 0x01ca, 2, 1 },
+    { 0x01cb, 0x01db, 1, 2 },
+    { 0x01de, 0x01ee, 1, 2 },
+    { 0x01f1, 0x01f1, 2, 1 },
+    { 0x01f2, 0x01f4, 1, 2 },
+    { 0x01f6, 0x01f6, -97, 1 },
+    { 0x01f7, 0x01f7, -56, 1 },
+    { 0x01f8, 0x021e, 1, 2 },
+    { 0x0220, 0x0220, -130, 1 },
+    { 0x0222, 0x0232, 1, 2 },
+    { 0x023b, 0x023b, 1, 1 },
+    { 0x023d, 0x023d, -163, 1 },
+    { 0x0241, 0x0241, 1, 1 },
+    { 0x0243, 0x0243, -195, 1 },
+    { 0x0244, 0x0244, 69, 1 },
+    { 0x0245, 0x0245, 71, 1 },
+    { 0x0246, 0x024e, 1, 2 },
+    { 0x0345, 0x0345, 116, 1 },
+    { 0x0370, 0x0372, 1, 2 },
+    { 0x0376, 0x0376, 1, 1 },
+    { 0x037f, 0x037f, 116, 1 },
+    { 0x0386, 0x0386, 38, 1 },
+    { 0x0388, 0x038a, 37, 1 },
+    { 0x038c, 0x038c, 64, 1 },
+    { 0x038e, 0x038f, 63, 1 },
+    { 0x0391, 0x03a1, 32, 1 },
+    { 0x03a3, 0x03ab, 32, 1 },
+    { 0x03c2, 0x03c2, 1, 1 },
+    { 0x03cf, 0x03cf, 8, 1 },
+    { 0x03d0, 0x03d0, -30, 1 },
+    { 0x03d1, 0x03d1, -25, 1 },
+    { 0x03d5, 0x03d5, -15, 1 },
+    { 0x03d6, 0x03d6, -22, 1 },
+    { 0x03d8, 0x03ee, 1, 2 },
+    { 0x03f0, 0x03f0, -54, 1 },
+    { 0x03f1, 0x03f1, -48, 1 },
+    { 0x03f4, 0x03f4, -60, 1 },
+    { 0x03f5, 0x03f5, -64, 1 },
+    { 0x03f7, 0x03f7, 1, 1 },
+    { 0x03f9, 0x03f9, -7, 1 },
+    { 0x03fa, 0x03fa, 1, 1 },
+    { 0x03fd, 0x03ff, -130, 1 },
+    { 0x0400, 0x040f, 80, 1 },
+    { 0x0410, 0x042f, 32, 1 },
+    { 0x0460, 0x0480, 1, 2 },
+    { 0x048a, 0x04be, 1, 2 },
+    { 0x04c0, 0x04c0, 15, 1 },
+    { 0x04c1, 0x04cd, 1, 2 },
+    { 0x04d0, 0x052e, 1, 2 },
+    { 0x0531, 0x0556, 48, 1 },
+    { 0x10a0, 0x10c5, 7264, 1 },
+    { 0x10c7, 0x10cd, 7264, 6 },
+    { 0x13f8, 0x13fd, -8, 1 },
+    { 0x1c80, 0x1c80, -6222, 1 },
+    { 0x1c81, 0x1c81, -6221, 1 },
+    { 0x1c82, 0x1c82, -6212, 1 },
+    { 0x1c83, 0x1c84, -6210, 1 },
+    { 0x1c85, 0x1c85, -6211, 1 },
+    { 0x1c86, 0x1c86, -6204, 1 },
+    { 0x1c87, 0x1c87, -6180, 1 },
+    { 0x1c88, 0x1c88, 35267, 1 },
+    { 0x1c90, 0x1cba, -3008, 1 },
+    { 0x1cbd, 0x1cbf, -3008, 1 },
+    { 0x1e00, 0x1e94, 1, 2 },
+    { 0x1e9b, 0x1e9b, -58, 1 },
+    { 0x1e9e, 0x1e9e, -7615, 1 },
+    { 0x1ea0, 0x1efe, 1, 2 },
+    { 0x1f08, 0x1f0f, -8, 1 },
+    { 0x1f18, 0x1f1d, -8, 1 },
+    { 0x1f28, 0x1f2f, -8, 1 },
+    { 0x1f38, 0x1f3f, -8, 1 },
+    { 0x1f48, 0x1f4d, -8, 1 },
+    { 0x1f59, 0x1f5f, -8, 2 },
+    { 0x1f68, 0x1f6f, -8, 1 },
+    { 0x1f88, 0x1f8f, -8, 1 },
+    { 0x1f98, 0x1f9f, -8, 1 },
+    { 0x1fa8, 0x1faf, -8, 1 },
+    { 0x1fb8, 0x1fb9, -8, 1 },
+    { 0x1fba, 0x1fbb, -74, 1 },
+    { 0x1fbc, 0x1fbc, -9, 1 },
+    { 0x1fbe, 0x1fbe, -7173, 1 },
+    { 0x1fc8, 0x1fcb, -86, 1 },
+    { 0x1fcc, 0x1fcc, -9, 1 },
+    { 0x1fd8, 0x1fd9, -8, 1 },
+    { 0x1fda, 0x1fdb, -100, 1 },
+    { 0x1fe8, 0x1fe9, -8, 1 },
+    { 0x1fea, 0x1feb, -112, 1 },
+    { 0x1fec, 0x1fec, -7, 1 },
+    { 0x1ff8, 0x1ff9, -128, 1 },
+    { 0x1ffa, 0x1ffb, -126, 1 },
+    { 0x1ffc, 0x1ffc, -9, 1 },
+    { 0x2126, 0x2126, -7517, 1 },
+    { 0x212a, 0x212a, -8383, 1 },
+    { 0x212b, 0x212b, -8262, 1 },
+    { 0x2132, 0x2132, 28, 1 },
+    { 0x2160, 0x216f, 16, 1 },
+    { 0x2183, 0x2183, 1, 1 },
+    { 0x24b6, 0x24cf, 26, 1 },
+    { 0x2c00, 0x2c2f, 48, 1 },
+    { 0x2c60, 0x2c60, 1, 1 },
+    { 0x2c62, 0x2c62, -10743, 1 },
+    { 0x2c63, 0x2c63, -3814, 1 },
+    { 0x2c64, 0x2c64, -10727, 1 },
+    { 0x2c67, 0x2c6b, 1, 2 },
+    { 0x2c6d, 0x2c6d, -10780, 1 },
+    { 0x2c6e, 0x2c6e, -10749, 1 },
+    { 0x2c6f, 0x2c6f, -10783, 1 },
+    { 0x2c70, 0x2c70, -10782, 1 },
+    { 0x2c72, 0x2c75, 1, 3 },
+    { 0x2c7e, 0x2c7f, -10815, 1 },
+    { 0x2c80, 0x2ce2, 1, 2 },
+    { 0x2ceb, 0x2ced, 1, 2 },
+    { 0x2cf2, 0x2cf2, 1, 1 },
+    { 0xa640, 0xa66c, 1, 2 },
+    { 0xa680, 0xa69a, 1, 2 },
+    { 0xa722, 0xa72e, 1, 2 },
+    { 0xa732, 0xa76e, 1, 2 },
+    { 0xa779, 0xa77b, 1, 2 },
+    { 0xa77d, 0xa77d, -35332, 1 },
+    { 0xa77e, 0xa786, 1, 2 },
+    { 0xa78b, 0xa78b, 1, 1 },
+    { 0xa78d, 0xa78d, -42280, 1 },
+    { 0xa790, 0xa792, 1, 2 },
+    { 0xa796, 0xa7a8, 1, 2 },
+    { 0xa7aa, 0xa7aa, -42308, 1 },
+    { 0xa7ab, 0xa7ab, -42319, 1 },
+    { 0xa7ac, 0xa7ac, -42315, 1 },
+    { 0xa7ad, 0xa7ad, -42305, 1 },
+    { 0xa7ae, 0xa7ae, -42308, 1 },
+    { 0xa7b0, 0xa7b0, -42258, 1 },
+    { 0xa7b1, 0xa7b1, -42282, 1 },
+    { 0xa7b2, 0xa7b2, -42261, 1 },
+    { 0xa7b3, 0xa7b3, 928, 1 },
+    { 0xa7b4, 0xa7c2, 1, 2 },
+    { 0xa7c4, 0xa7c4, -48, 1 },
+    { 0xa7c5, 0xa7c5, -42307, 1 },
+    { 0xa7c6, 0xa7c6, -35384, 1 },
+    { 0xa7c7, 0xa7c9, 1, 2 },
+    { 0xa7d0, 0xa7d6, 1, 6 },
+    { 0xa7d8, 0xa7f5, 1, 29 },
+    { 0xab70, 0xabbf, -38864, 1 },
+    { 0xff21, 0xff3a, 32, 1 },
+    { 0x10400, 0x10427, 40, 1 },
+    { 0x104b0, 0x104d3, 40, 1 },
+    { 0x10570, 0x1057a, 39, 1 },
+    { 0x1057c, 0x1058a, 39, 1 },
+    { 0x1058c, 0x10592, 39, 1 },
+    { 0x10594, 0x10595, 39, 1 },
+    { 0x10c80, 0x10cb2, 64, 1 },
+    { 0x118a0, 0x118bf, 32, 1 },
+    { 0x16e40, 0x16e5f, 32, 1 },
+    { 0x1e900, 0x1e921, 34, 1 },
+};
+/* END case tables */
+
+template <std::size_t N>
+char32_t map_case(const Case_range (&ranges)[N], char32_t code_point) noexcept
+{
+    auto range = std::upper_bound(ranges, ranges + N, code_point, [](char32_t c, const Case_range& r) { return c < r.first; });
+    if (range == ranges || code_point > (--range)->last || (code_point - range->first) % range->step)
+        return code_point;
+    return static_cast<char32_t>(static_cast<std::int32_t>(code_point) + range->delta);
+}
+
+inline char32_t to_lower(char32_t code_point) noexcept
+{
+    return map_case(lower_ranges, code_point);
+}
+
+inline char32_t to_upper(char32_t code_point) noexcept
+{
+    return map_case(upper_ranges, code_point);
+}
+
+inline char32_t fold_case(char32_t code_point) noexcept
+{
+    return map_case(fold_ranges, code_point);
+}
+
+inline char32_t swap_case(char32_t code_point) noexcept
+{
+    auto upper = to_upper(code_point);
+    return upper != code_point ? upper : to_lower(code_point);
+}
+
+/* Maps the code points of [first, last) that are not ASCII through
+ * map(code_point, is_first), compacting the buffer when a mapping is
+ * shorter. The ASCII bytes have to be mapped beforehand. Returns the
+ * new end. */
+template <typename Map>
+char* map_non_ascii(char* first, char* last, Map map) noexcept
+{
+    auto out = first;
+    for (const char* in = first;;) {
+        auto next = find_non_ascii(in, last);
+        if (out != in)
+            std::memmove(out, in, static_cast<std::size_t>(next - in));
+        out += next - in;
+        in = next;
+        if (in == last)
+            return out;
+
+        char32_t code_point;
+        auto length = decode_utf8(in, last, code_point);
+        if (!length) {
+            *out++ = *in++;
+            continue;
+        }
+
+        auto mapped = map(code_point, in == first);
+        if (mapped != code_point) {
+            out += encode_utf8(mapped, out);
+        } else {
+            std::memmove(out, in, length);
+            out += length;
+        }
+        in += length;
+    }
+}
+}
+
+namespace utf8 {
+/* Whether string is well-formed UTF-8: no overlong encodings, no
+ * surrogates, nothing above U+10FFFF and no truncated sequences */
+inline bool isvalid(StringView string) noexcept
+{
+    return detail::valid_utf8(string.begin(), string.end());
+}
+
+inline bool isascii(StringView string) noexcept
+{
+    return detail::find_non_ascii(string.begin(), string.end()) == string.end();
+}
+
+/* Number of code points, like Python's len(). Expects valid UTF-8. */
+inline StringView::size_type len(StringView string) noexcept
+{
+    return detail::count_code_points(string.begin(), string.end());
+}
+
+template <typename Allocator>
+BasicString<Allocator>& upper(BasicString<Allocator>& string)
+{
+    string.upper();
+    string.str.resize(static_cast<std::size_t>(detail::map_non_ascii(string.begin(), string.end(), [](char32_t c, bool) { return detail::to_upper(c); }) - string.begin()));
+    return string;
+}
+
+template <typename Allocator>
+BasicString<Allocator>& lower(BasicString<Allocator>& string)
+{
+    string.lower();
+    string.str.resize(static_cast<std::size_t>(detail::map_non_ascii(string.begin(), string.end(), [](char32_t c, bool) { return detail::to_lower(c); }) - string.begin()));
+    return string;
+}
+
+/* Simple case folding, so for example "\u00df" stays as it is where
+ * Python's casefold() gives "ss" */
+template <typename Allocator>
+BasicString<Allocator>& casefold(BasicString<Allocator>& string)
+{
+    string.casefold();
+    string.str.resize(static_cast<std::size_t>(detail::map_non_ascii(string.begin(), string.end(), [](char32_t c, bool) { return detail::fold_case(c); }) - string.begin()));
+    return string;
+}
+
+template <typename Allocator>
+BasicString<Allocator>& swapcase(BasicString<Allocator>& string)
+{
+    string.swapcase();
+    string.str.resize(static_cast<std::size_t>(detail::map_non_ascii(string.begin(), string.end(), [](char32_t c, bool) { return detail::swap_case(c); }) - string.begin()));
+    return string;
+}
+
+/* Uppercases the first code point and lowercases the rest */
+template <typename Allocator>
+BasicString<Allocator>& capitalize(BasicString<Allocator>& string)
+{
+    string.capitalize();
+    string.str.resize(static_cast<std::size_t>(detail::map_non_ascii(string.begin(), string.end(), [](char32_t c, bool is_first) { return is_first ? detail::to_upper(c) : detail::to_lower(c); }) - string.begin()));
+    return string;
+}
+}
+
+/* Text stored as a treap of immutable, shared chunks for workloads
+ * with many edits. insert(), del(), slice() and operator[] are
+ * O(log n) instead of shifting the whole tail like String does. Nodes
+ * are never modified, edits copy the O(log n) nodes on the path, so
+ * copies and slices share their chunks with the original. */
+class Rope {
+public:
+    using size_type = std::string::size_type;
+
+    static constexpr size_type Chunk_size = 1024;
+
+    Rope() = default;
+
+    explicit Rope(StringView string)
+        : root(build(string))
+    {
+    }
+
+    explicit Rope(const char* string)
+        : Rope(StringView(string))
+    {
+    }
+
+    size_type str_index(int rel_pos) const noexcept
+    {
+        return static_cast<size_type>(rel_pos >= 0 ? rel_pos : size() + rel_pos);
+    }
+
+    bool empty() const noexcept
+    {
+        return !root;
+    }
+
+    size_type size() const noexcept
+    {
+        return size_of(root);
+    }
+
+    size_type len() const noexcept
+    {
+        return size();
+    }
+
+    char operator[](int pos) const noexcept
+    {
+        auto index = str_index(pos);
+        for (auto node = root.get(); node;) {
+            auto left = size_of(node->left);
+            if (index < left) {
+                node = node->left.get();
+            } else if (index < left + node->length) {
+                return (*node->text)[node->offset + index - left];
+            } else {
+                index -= left + node->length;
+                node = node->right.get();
+            }
+        }
+
+        return '\0';
+    }
+
+    /* from and to indexes are included */
+    Rope slice(int from, int to) const
+    {
+        if (empty())
+            return {};
+
+        auto first = str_index(from);
+        auto last = std::min(str_index(to), size() - 1);
+        if (first > last || first >= size())
+            return {};
+
+        auto tail = split(root, first).second;
+        return Rope(split(tail, last - first + 1).first);
+    }
+
+    Rope operator()(int from, int to) const
+    {
+        return slice(from, to);
+    }
+
+    Rope& operator+=(char c)
+    {
+        return insert(static_cast<int>(size()), StringView(&c, 1));
+    }
+
+    Rope& operator+=(StringView string)
+    {
+        root = merge(root, build(string));
+        return *this;
+    }
+
+    Rope& operator+=(const Rope& rope)
+    {
+        root = merge(root, rope.root);
+        return *this;
+    }
+
+    Rope& insert(int pos, char c)
+    {
+        return insert(pos, StringView(&c, 1));
+    }
+
+    /* Short insertions are merged into the chunk before them, so typing
+     * character by character does not create a node per character */
+    Rope& insert(int pos, StringView string)
+    {
+        if (string.empty())
+            return *this;
+
+        auto parts = split(root, std::min(str_index(pos), size()));
+        auto last = last_chunk(parts.first);
+        if (last && last->length + string.size() <= Chunk_size / 2) {
+            auto head = split(parts.first, size_of(parts.first) - last->length).first;
+            auto text = std::make_shared<std::string>();
+            text->reserve(last->length + string.size());
+            text->append(*last->text, last->offset, last->length).append(string.data(), string.size());
+            parts.first = merge(head, leaf(std::move(text)));
+        } else {
+            parts.first = merge(parts.first, build(string));
+        }
+
+        root = merge(parts.first, parts.second);
+        return *this;
+    }
+
+    Rope& insert(int pos, const Rope& rope)
+    {
+        auto parts = split(root, std::min(str_index(pos), size()));
+        root = merge(merge(parts.first, rope.root), parts.second);
+        return *this;
+    }
+
+    Rope& del(int pos)
+    {
+        return del(pos, pos);
+    }
+
+    /* Deletes from and to indexes, both included */
+    Rope& del(int from, int to)
+    {
+        auto first = str_index(from);
+        auto last = std::min(str_index(to), size() - 1);
+        if (empty() || first > last || first >= size())
+            return *this;
+
+        auto parts = split(root, first);
+        root = merge(parts.first, split(parts.second, last - first + 1).second);
+        return *this;
+    }
+
+    bool startswith(StringView value) const
+    {
+        return value.size() <= size() && compare_from(0, value);
+    }
+
+    bool endswith(StringView value) const
+    {
+        return value.size() <= size() && compare_from(size() - value.size(), value);
+    }
+
+    /* The searches walk the chunks in order and carry the last
+     * value.size() - 1 characters over, so matches crossing a chunk
+     * boundary are found without flattening the rope. */
+    size_type find(StringView value) const
+    {
+        if (value.empty())
+            return 0;
+
+        auto result = Not_found;
+        for_each_match(value, [&result](size_type pos) {
+            result = pos;
+            return false;
+        });
+
+        return result;
+    }
+
+    size_type index(StringView value) const
+    {
+        return find(value);
+    }
+
+    size_type rfind(StringView value) const
+    {
+        if (value.empty())
+            return size();
+
+        auto result = Not_found;
+        for_each_match(value, [&result](size_type pos) {
+            result = pos;
+            return true;
+        });
+
+        return result;
+    }
+
+    size_type rindex(StringView value) const
+    {
+        return rfind(value);
+    }
+
+    /* Non-overlapping occurrences, like Python's str.count() */
+    size_type count(StringView value) const
+    {
+        if (value.empty())
+            return size() + 1;
+
+        size_type result = 0;
+        size_type next = 0;
+        for_each_match(value, [&](size_type pos) {
+            if (pos >= next) {
+                ++result;
+                next = pos + value.size();
+            }
+            return true;
+        });
+
+        return result;
+    }
+
+    /* False for an empty value, like String::contains() */
+    bool contains(StringView value) const
+    {
+        return !value.empty() && find(value) != Not_found;
+    }
+
+    /* Calls f with a StringView of every chunk, in order */
+    template <typename F>
+    void for_each_chunk(F f) const
+    {
+        visit(root.get(), f);
+    }
+
+    /* Number of nodes on the longest path from the root, O(log n) as
+     * long as the treap stays balanced */
+    size_type height() const noexcept
+    {
+        return height(root.get());
+    }
+
+    /* Copies the text into a String with a single allocation */
+    String flatten() const
+    {
+        std::string result;
+        result.reserve(size());
+        for_each_chunk([&result](StringView chunk) { result.append(chunk.data(), chunk.size()); });
+        return String(std::move(result));
+    }
+
+    friend bool operator==(const Rope& lhs, StringView rhs)
+    {
+        return lhs.size() == rhs.size() && lhs.compare_from(0, rhs);
+    }
+
+    friend bool operator!=(const Rope& lhs, StringView rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const Rope& rope)
+    {
+        rope.for_each_chunk([&out](StringView chunk) { out << chunk; });
+        return out;
+    }
+
+private:
+    struct Node;
+    using Link = std::shared_ptr<const Node>;
+
+    struct Node {
+        std::shared_ptr<const std::string> text;
+        size_type offset;
+        size_type length;
+        Link left;
+        Link right;
+        size_type size;
+        std::uint32_t priority;
+    };
+
+    explicit Rope(Link root)
+        : root(std::move(root))
+    {
+    }
+
+    static size_type size_of(const Link& node) noexcept
+    {
+        return node ? node->size : 0;
+    }
+
+    static size_type size_of(const Node* node) noexcept
+    {
+        return node ? node->size : 0;
+    }
+
+    static std::uint32_t random_priority() noexcept
+    {
+        thread_local std::uint32_t state = 0x9e3779b9u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    static Link make(const Node& chunk, size_type offset, size_type length, Link left, Link right, std::uint32_t priority)
+    {
+        auto size = size_of(left) + length + size_of(right);
+        return std::make_shared<const Node>(Node { chunk.text, offset, length, std::move(left), std::move(right), size, priority });
+    }
+
+    static Link leaf(std::shared_ptr<const std::string> text)
+    {
+        auto length = text->size();
+        return std::make_shared<const Node>(Node { std::move(text), 0, length, nullptr, nullptr, length, random_priority() });
+    }
+
+    /* Balanced tree over Chunk_size pieces of one shared buffer. The
+     * priority bands shrink with depth, so the heap order holds. */
+    static Link build(StringView string)
+    {
+        if (string.empty())
+            return nullptr;
+
+        auto text = std::make_shared<const std::string>(string.data(), string.size());
+        auto chunks = (string.size() + Chunk_size - 1) / Chunk_size;
+        return build(text, 0, chunks, 0);
+    }
+
+    static Link build(const std::shared_ptr<const std::string>& text, size_type first, size_type last, unsigned depth)
+    {
+        if (first == last)
+            return nullptr;
+
+        auto middle = first + (last - first) / 2;
+        auto offset = middle * Chunk_size;
+        auto length = std::min(Chunk_size, text->size() - offset);
+        auto priority = (static_cast<std::uint32_t>(63 - std::min(depth, 63u)) << 26) | (random_priority() >> 6);
+        Node chunk { text, 0, 0, nullptr, nullptr, 0, 0 };
+        return make(chunk, offset, length, build(text, first, middle, depth + 1), build(text, middle + 1, last, depth + 1), priority);
+    }
+
+    static Link merge(const Link& lhs, const Link& rhs)
+    {
+        if (!lhs)
+            return rhs;
+        if (!rhs)
+            return lhs;
+
+        if (lhs->priority > rhs->priority)
+            return make(*lhs, lhs->offset, lhs->length, lhs->left, merge(lhs->right, rhs), lhs->priority);
+
+        return make(*rhs, rhs->offset, rhs->length, merge(lhs, rhs->left), rhs->right, rhs->priority);
+    }
+
+    /* Splits into the first pos characters and the rest, cutting a
+     * chunk in two when pos falls inside of it */
+    static std::pair<Link, Link> split(const Link& node, size_type pos)
+    {
+        bool cut = false;
+        auto parts = split(node, pos, cut);
+        if (cut) {
+            /* Both pieces of the cut chunk have its priority. The second
+             * one is taken out and merged back with a new priority, so
+             * repeated cuts do not build chains of equal priorities. */
+            auto first = first_chunk(parts.second);
+            auto rest = split(parts.second, first->length, cut).second;
+            parts.second = merge(make(*first, first->offset, first->length, nullptr, nullptr, random_priority()), rest);
+        }
+        return parts;
+    }
+
+    static std::pair<Link, Link> split(const Link& node, size_type pos, bool& cut)
+    {
+        if (!node)
+            return {};
+
+        auto left = size_of(node->left);
+        if (pos <= left) {
+            auto parts = split(node->left, pos, cut);
+            return { parts.first, make(*node, node->offset, node->length, parts.second, node->right, node->priority) };
+        }
+
+        if (pos >= left + node->length) {
+            auto parts = split(node->right, pos - left - node->length, cut);
+            return { make(*node, node->offset, node->length, node->left, parts.first, node->priority), parts.second };
+        }
+
+        cut = true;
+        auto length = pos - left;
+        return { make(*node, node->offset, length, node->left, nullptr, node->priority),
+            make(*node, node->offset + length, node->length - length, nullptr, node->right, node->priority) };
+    }
+
+    static const Node* first_chunk(const Link& node) noexcept
+    {
+        auto first = node.get();
+        while (first && first->left)
+            first = first->left.get();
+        return first;
+    }
+
+    static size_type height(const Node* node) noexcept
+    {
+        return node ? 1 + std::max(height(node->left.get()), height(node->right.get())) : 0;
+    }
+
+    static const Node* last_chunk(const Link& node) noexcept
+    {
+        auto last = node.get();
+        while (last && last->right)
+            last = last->right.get();
+        return last;
+    }
+
+    template <typename F>
+    static void visit(const Node* node, F&& f)
+    {
+        while (node) {
+            visit(node->left.get(), f);
+            f(StringView(node->text->data() + node->offset, node->length));
+            node = node->right.get();
+        }
+    }
+
+    /* Calls f with the start of every occurrence of value, overlapping
+     * ones included, in increasing order until f returns false */
+    template <typename F>
+    void for_each_match(StringView value, F f) const
+    {
+        std::string carry;
+        size_type base = 0;
+        bool done = false;
+        visit(root.get(), [&](StringView chunk) {
+            if (done)
+                return;
+
+            /* Matches starting in the carried characters */
+            carry.append(chunk.data(), std::min(chunk.size(), value.size() - 1));
+            auto carried = carry.size() - std::min(chunk.size(), value.size() - 1);
+            const char* window = carry.data();
+            for (auto pos = window;; ++pos) {
+                pos = detail::find_substring(pos, window + carry.size(), value.data(), value.size());
+                if (pos == window + carry.size() || static_cast<size_type>(pos - window) >= carried)
+                    break;
+                if (!f(base - carried + static_cast<size_type>(pos - window))) {
+                    done = true;
+                    return;
+                }
+            }
+
+            for (auto pos = chunk.begin();; ++pos) {
+                pos = detail::find_substring(pos, chunk.end(), value.data(), value.size());
+                if (pos == chunk.end())
+                    break;
+                if (!f(base + static_cast<size_type>(pos - chunk.begin()))) {
+                    done = true;
+                    return;
+                }
+            }
+
+            if (chunk.size() >= value.size() - 1) {
+                carry.assign(chunk.end() - (value.size() - 1), value.size() - 1);
+            } else if (carry.size() > value.size() - 1) {
+                carry.erase(0, carry.size() - (value.size() - 1));
+            }
+            base += chunk.size();
+        });
+    }
+
+    /* Compares value against the characters from pos on, visiting only
+     * the chunks that overlap them */
+    bool compare_from(size_type pos, StringView value) const
+    {
+        auto range = split(split(root, pos).second, value.size()).first;
+        size_type offset = 0;
+        bool equal = true;
+        visit(range.get(), [&](StringView chunk) {
+            equal = equal && std::memcmp(chunk.data(), value.data() + offset, chunk.size()) == 0;
+            offset += chunk.size();
+        });
+
+        return equal;
+    }
+
+    Link root;
+};
+
+/* Compiled set of (old, new) replacements that are all applied in a
+ * single left-to-right pass (Aho-Corasick automaton). When several
+ * patterns match, the leftmost match wins, and of the matches starting
+ * at the same position the longest one. */
+class Replacer {
+public:
+    using size_type = String::size_type;
+
+    Replacer(std::initializer_list<std::pair<StringView, StringView>> replacements)
+    {
+        for (const auto& replacement : replacements)
+            add(replacement.first, replacement.second);
+        build();
+    }
+
+    template <typename Range>
+    explicit Replacer(const Range& replacements)
+    {
+        for (const auto& replacement : replacements)
+            add(StringView(replacement.first), StringView(replacement.second));
+        build();
+    }
+
+    template <typename Allocator>
+    BasicString<Allocator>& replace(BasicString<Allocator>& string) const
+    {
+        typename BasicString<Allocator>::string_type result(string.get_allocator());
+        if (run(string, result))
+            string.str.swap(result);
+
+        return string;
+    }
+
+    String replaced(StringView string) const
+    {
+        std::string result;
+        if (!run(string, result))
+            result.assign(string.data(), string.size());
+
+        return String(std::move(result));
+    }
+
+private:
+    static constexpr std::int32_t No_pattern = -1;
+
+    void add(StringView oldvalue, StringView newvalue)
+    {
+        if (oldvalue.empty())
+            throw std::invalid_argument("empty pattern");
+
+        patterns.emplace_back(std::string(oldvalue), std::string(newvalue));
+    }
+
+    void build()
+    {
+        /* Bytes that never occur in a pattern share class 0 */
+        classes = 1;
+        for (const auto& pattern : patterns)
+            for (unsigned char c : pattern.first)
+                if (!byte_class[c])
+                    byte_class[c] = static_cast<std::uint16_t>(classes++);
+
+        /* Trie, later turned into a complete transition table */
+        transitions.assign(classes, 0);
+        depth.assign(1, 0);
+        match.assign(1, No_pattern);
+        for (std::size_t i = 0; i < patterns.size(); ++i) {
+            std::int32_t state = 0;
+            for (unsigned char c : patterns[i].first) {
+                auto& next = transitions[state * classes + byte_class[c]];
+                if (!next) {
+                    next = static_cast<std::int32_t>(depth.size());
+                    transitions.resize(transitions.size() + classes, 0);
+                    depth.push_back(depth[state] + 1);
+                    match.push_back(No_pattern);
+                }
+                state = transitions[state * classes + byte_class[c]];
+            }
+            if (match[state] == No_pattern)
+                match[state] = static_cast<std::int32_t>(i);
+        }
+
+        /* Breadth first, so failure states are complete before use. A
+         * state without a pattern of its own inherits the longest match
+         * of its failure state, which is the longest pattern ending there. */
+        std::vector<std::int32_t> failure(depth.size(), 0);
+        std::vector<std::int32_t> queue;
+        for (std::size_t c = 0; c < classes; ++c)
+            if (transitions[c])
+                queue.push_back(transitions[c]);
+
+        for (std::size_t head = 0; head < queue.size(); ++head) {
+            auto state = queue[head];
+            if (match[state] == No_pattern)
+                match[state] = match[failure[state]];
+
+            for (std::size_t c = 0; c < classes; ++c) {
+                auto& next = transitions[state * classes + c];
+                auto fallback = transitions[failure[state] * classes + c];
+                if (next) {
+                    failure[next] = fallback;
+                    queue.push_back(next);
+                } else {
+                    next = fallback;
+                }
+            }
+        }
+    }
+
+    /* Writes the replaced string into result, returns false without
+     * touching result when nothing matched. */
+    template <typename Result>
+    bool run(StringView text, Result& result) const
+    {
+        auto size = text.size();
+        size_type emitted = 0;
+        size_type best_start = Not_found;
+        size_type best_size = 0;
+        std::int32_t best = No_pattern;
+        std::int32_t state = 0;
+        bool replaced = false;
+
+        for (size_type pos = 0; pos < size || best != No_pattern;) {
+            if (pos < size) {
+                state = transitions[state * classes + byte_class[static_cast<unsigned char>(text.data()[pos++])]];
+
+                /* The longest match ending here is the leftmost one */
+                auto found = match[state];
+                if (found != No_pattern) {
+                    auto found_size = patterns[found].first.size();
+                    auto found_start = pos - found_size;
+                    if (best == No_pattern || found_start < best_start || (found_start == best_start && found_size > best_size)) {
+                        best = found;
+                        best_start = found_start;
+                        best_size = found_size;
+                    }
+                }
+
+                /* A later match could still start at or before best_start */
+                if (best == No_pattern || pos - depth[state] <= best_start)
+                    continue;
+            }
+
+            if (!replaced)
+                result.reserve(size);
+            replaced = true;
+            result.append(text.data() + emitted, best_start - emitted);
+            result += patterns[best].second;
+            emitted = pos = best_start + best_size;
+            state = 0;
+            best = No_pattern;
+        }
+
+        if (!replaced)
+            return false;
+
+        result.append(text.data() + emitted, size - emitted);
+        return true;
+    }
+
+    std::vector<std::pair<std::string, std::string>> patterns;
+    std::uint16_t byte_class[256] {};
+    std::size_t classes = 1;
+    std::vector<std::int32_t> transitions;
+    std::vector<std::int32_t> depth;
+    std::vector<std::int32_t> match;
+};
+
+/* Set of rows selected by a batch predicate of StringColumn, one bit
+ * per row */
+class Bitmap {
+public:
+    using size_type = std::size_t;
+
+    explicit Bitmap(size_type size = 0)
+        : words((size + 63) / 64, 0)
+        , bits(size)
+    {
+    }
+
+    size_type size() const noexcept
+    {
+        return bits;
+    }
+
+    bool operator[](size_type pos) const noexcept
+    {
+        return (words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    void set(size_type pos) noexcept
+    {
+        words[pos / 64] |= std::uint64_t(1) << (pos % 64);
+    }
+
+    /* Number of selected rows */
+    size_type count() const noexcept
+    {
+        size_type result = 0;
+        for (auto word : words)
+            result += detail::popcount(static_cast<std::uint32_t>(word)) + detail::popcount(static_cast<std::uint32_t>(word >> 32));
+
+        return result;
+    }
+
+private:
+    std::vector<std::uint64_t> words;
+    size_type bits;
+};
+
+struct ListColumn;
+
+/* Many strings stored back to back in one buffer, with the end offset
+ * of every row in a second array, like an Arrow string array. Adding a
+ * row does not allocate on its own, and the batch methods run over the
+ * whole buffer at once instead of row by row: upper() is a single
+ * pass of the case mapping kernel, and contains(), count() and
+ * replace() search the buffer once and map every match back to its row.
+ * Like String, the mutating methods change the column in place. */
+class StringColumn {
+public:
+    using size_type = std::string::size_type;
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StringView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StringView*;
+        using reference = StringView;
+
+        iterator() = default;
+
+        StringView operator*() const noexcept
+        {
+            return (*column)[row];
+        }
+
+        iterator& operator++() noexcept
+        {
+            ++row;
+            return *this;
+        }
+
+        iterator operator++(int) noexcept
+        {
+            auto copy = *this;
+            ++row;
+            return copy;
+        }
+
+        friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return lhs.row == rhs.row;
+        }
+
+        friend bool operator!=(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class StringColumn;
+
+        iterator(const StringColumn* column, size_type row) noexcept
+            : column(column)
+            , row(row)
+        {
+        }
+
+        const StringColumn* column = nullptr;
+        size_type row = 0;
+    };
+
+    StringColumn() = default;
+
+    StringColumn(std::initializer_list<StringView> strings)
+    {
+        append(strings);
+    }
+
+    /* Any range of String, StringView, std::string or const char* */
+    template <typename Range, typename = std::enable_if_t<detail::is_string_range<Range>::value>>
+    explicit StringColumn(const Range& strings)
+    {
+        append(strings);
+    }
+
+    void reserve(size_type rows, size_type total_bytes)
+    {
+        bounds.reserve(rows + 1);
+        bytes.reserve(total_bytes);
+    }
+
+    void push_back(StringView string)
+    {
+        bytes.append(string.data(), string.size());
+        bounds.push_back(bytes.size());
+    }
+
+    size_type size() const noexcept
+    {
+        return bounds.size() - 1;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    StringView operator[](size_type row) const noexcept
+    {
+        return { bytes.data() + bounds[row], bounds[row + 1] - bounds[row] };
+    }
+
+    iterator begin() const noexcept
+    {
+        return { this, 0 };
+    }
+
+    iterator end() const noexcept
+    {
+        return { this, size() };
+    }
+
+    /* All rows back to back */
+    StringView buffer() const noexcept
+    {
+        return bytes;
+    }
+
+    /* size() + 1 offsets into buffer(), row i is [offsets()[i], offsets()[i + 1]) */
+    const std::vector<size_type>& offsets() const noexcept
+    {
+        return bounds;
+    }
+
+    StringColumn& upper()
+    {
+        detail::ascii_upper(&bytes[0], &bytes[0] + bytes.size());
+        return *this;
+    }
+
+    StringColumn& lower()
+    {
+        detail::ascii_lower(&bytes[0], &bytes[0] + bytes.size());
+        return *this;
+    }
+
+    StringColumn& lstrip(const char ch = ' ')
+    {
+        return strip_rows(StringView(&ch, 1), true, false);
+    }
+
+    StringColumn& lstrip(StringView chars)
+    {
+        return strip_rows(chars, true, false);
+    }
+
+    StringColumn& rstrip(const char ch = ' ')
+    {
+        return strip_rows(StringView(&ch, 1), false, true);
+    }
+
+    StringColumn& rstrip(StringView chars)
+    {
+        return strip_rows(chars, false, true);
+    }
+
+    StringColumn& strip(const char ch = ' ')
+    {
+        return strip_rows(StringView(&ch, 1), true, true);
+    }
+
+    StringColumn& strip(StringView chars)
+    {
+        return strip_rows(chars, true, true);
+    }
+
+    Bitmap startswith(StringView value) const
+    {
+        Bitmap result(size());
+        for (size_type row = 0; row < size(); ++row)
+            if (bounds[row + 1] - bounds[row] >= value.size() && std::memcmp(bytes.data() + bounds[row], value.data(), value.size()) == 0)
+                result.set(row);
+
+        return result;
+    }
+
+    /* Rows that contain value, an empty value is contained in none like
+     * String::contains() */
+    Bitmap contains(StringView value) const
+    {
+        Bitmap result(size());
+        if (value.empty())
+            return result;
+
+        for_each_match(value, [&result](size_type row, size_type) {
+            result.set(row);
+            return false;
+        });
+        return result;
+    }
+
+    /* Non-overlapping occurrences of value in every row */
+    std::vector<size_type> count(StringView value) const
+    {
+        std::vector<size_type> result(size(), 0);
+        if (value.empty()) {
+            for (size_type row = 0; row < size(); ++row)
+                result[row] = bounds[row + 1] - bounds[row] + 1;
+            return result;
+        }
+
+        for_each_match(value, [&result](size_type row, size_type) {
+            ++result[row];
+            return true;
+        });
+        return result;
+    }
+
+    /* Replaces the first count occurrences of oldvalue in every row, all
+     * of them if count is negative */
+    StringColumn& replace(StringView oldvalue, StringView newvalue, int count = -1)
+    {
+        auto last = bytes.data() + bytes.size();
+        if (detail::points_into(oldvalue.data(), bytes.data(), last) || detail::points_into(newvalue.data(), bytes.data(), last))
+            return replace(String(oldvalue), String(newvalue), count);
+
+        auto limit = count < 0 ? Not_found : static_cast<size_type>(count);
+        if (oldvalue.empty()) {
+            StringColumn result;
+            result.reserve(size(), bytes.size());
+            for (auto row : *this)
+                result.push_back(String(row).replace(oldvalue, newvalue, count));
+            return *this = std::move(result);
+        }
+
+        std::vector<size_type> matches(size(), 0);
+        if (oldvalue.size() == newvalue.size()) {
+            for_each_match(oldvalue, [&](size_type row, size_type pos) {
+                if (matches[row] == limit)
+                    return false;
+                ++matches[row];
+                std::memcpy(&bytes[pos], newvalue.data(), newvalue.size());
+                return true;
+            });
+            return *this;
+        }
+
+        std::string result;
+        size_type emitted = 0;
+        for_each_match(oldvalue, [&](size_type row, size_type pos) {
+            if (matches[row] == limit)
+                return false;
+            if (result.empty())
+                result.reserve(bytes.size());
+            ++matches[row];
+            result.append(bytes, emitted, pos - emitted).append(newvalue.data(), newvalue.size());
+            emitted = pos + oldvalue.size();
+            return true;
+        });
+        if (emitted == 0)
+            return *this;
+
+        result.append(bytes, emitted, Not_found);
+        bytes.swap(result);
+
+        size_type replaced = 0;
+        for (size_type row = 0; row < size(); ++row) {
+            replaced += matches[row];
+            bounds[row + 1] = bounds[row + 1] + replaced * newvalue.size() - replaced * oldvalue.size();
+        }
+        return *this;
+    }
+
+    /* Splits every row on runs of whitespace */
+    ListColumn split(int maxsplit = -1) const;
+
+    /* Splits every row on every occurrence of sep */
+    ListColumn split(StringView sep, int maxsplit = -1) const;
+
+    /* The rows selected by selection, in order */
+    StringColumn filter(const Bitmap& selection) const
+    {
+        StringColumn result;
+        for (size_type row = 0; row < size(); ++row)
+            if (selection[row])
+                result.push_back((*this)[row]);
+
+        return result;
+    }
+
+    friend bool operator==(const StringColumn& lhs, const StringColumn& rhs) noexcept
+    {
+        return lhs.bounds == rhs.bounds && lhs.bytes == rhs.bytes;
+    }
+
+    friend bool operator!=(const StringColumn& lhs, const StringColumn& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+private:
+    template <typename Range>
+    void append(const Range& strings)
+    {
+        for (const auto& string : strings)
+            push_back(StringView(string));
+    }
+
+    /* Searches the whole buffer once and calls f(row, pos) for every
+     * non-overlapping match that lies within a single row, in order.
+     * When f returns false the search skips to the next row. */
+    template <typename F>
+    void for_each_match(StringView needle, F f) const
+    {
+        auto first = bytes.data();
+        auto last = first + bytes.size();
+        size_type row = 0;
+        for (auto from = first;;) {
+            auto found = detail::find_substring(from, last, needle.data(), needle.size());
+            if (found == last)
+                return;
+
+            auto pos = static_cast<size_type>(found - first);
+            while (bounds[row + 1] <= pos)
+                ++row;
+
+            if (pos + needle.size() <= bounds[row + 1] && f(row, pos))
+                from = found + needle.size();
+            else
+                from = first + bounds[row + 1];
+        }
+    }
+
+    StringColumn& strip_rows(StringView chars, bool left, bool right)
+    {
+        auto set = std::string_view(chars);
+        size_type out = 0;
+        size_type start = 0;
+        for (size_type row = 0; row < size(); ++row) {
+            auto text = std::string_view(bytes.data() + start, bounds[row + 1] - start);
+            start = bounds[row + 1];
+
+            auto from = left ? std::min(text.find_first_not_of(set), text.size()) : 0;
+            auto to = right ? text.find_last_not_of(set) + 1 : text.size();
+            auto length = to > from ? to - from : 0;
+            std::memmove(&bytes[0] + out, text.data() + from, length);
+            out += length;
+            bounds[row + 1] = out;
+        }
+
+        bytes.resize(out);
+        return *this;
+    }
+
+    std::string bytes;
+    std::vector<size_type> bounds { 0 };
+};
+
+/* Result of StringColumn::split(): the parts of every row in one
+ * column, row i has the parts values[offsets[i]] ... values[offsets[i + 1] - 1] */
+struct ListColumn {
+    using size_type = StringColumn::size_type;
+
+    size_type size() const noexcept
+    {
+        return offsets.size() - 1;
+    }
+
+    StringColumn values;
+    std::vector<size_type> offsets { 0 };
+};
+
+inline ListColumn StringColumn::split(int maxsplit) const
+{
+    ListColumn result;
+    result.values.reserve(size(), bytes.size());
+    result.offsets.reserve(bounds.size());
+    for (auto row : *this) {
+        for (auto token : row.split_view(maxsplit))
+            result.values.push_back(token);
+        result.offsets.push_back(result.values.size());
+    }
+
+    return result;
+}
+
+inline ListColumn StringColumn::split(StringView sep, int maxsplit) const
+{
+    ListColumn result;
+    result.values.reserve(size(), bytes.size());
+    result.offsets.reserve(bounds.size());
+    for (auto row : *this) {
+        for (auto token : row.split_view(sep, maxsplit))
+            result.values.push_back(token);
+        result.offsets.push_back(result.values.size());
+    }
+
+    return result;
+}
+
+#if defined(PY_STRING_POSIX)
+/* A file mapped read-only into memory and viewed as a StringView, so
+ * it can be searched or split without reading it into a String first.
+ * The kernel is told that the mapping will be read sequentially and
+ * may be backed by huge pages. Views into the file are valid as long
+ * as the MappedFile lives. */
+class MappedFile : public StringView {
+public:
+    explicit MappedFile(const char* path)
+    {
+        auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), std::string("open ") + path);
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            auto error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), std::string("stat ") + path);
+        }
+
+        /* mmap() rejects empty mappings, an empty file is an empty view */
+        auto size = static_cast<size_type>(info.st_size);
+        void* mapping = nullptr;
+        if (size) {
+            mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                auto error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), std::string("mmap ") + path);
+            }
+
+            ::madvise(mapping, size, MADV_SEQUENTIAL);
+#    if defined(MADV_HUGEPAGE)
+            ::madvise(mapping, size, MADV_HUGEPAGE);
+#    endif
+        }
+
+        ::close(fd);
+        StringView::operator=(StringView(static_cast<const char*>(mapping), size));
+    }
+
+    explicit MappedFile(const std::string& path)
+        : MappedFile(path.c_str())
+    {
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+        : StringView(other)
+    {
+        other.StringView::operator=(StringView());
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            unmap();
+            StringView::operator=(other);
+            other.StringView::operator=(StringView());
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+private:
+    void unmap() noexcept
+    {
+        if (!empty())
+            ::munmap(const_cast<char*>(data()), size());
+    }
+};
+#endif
+
+/* Reads lines from a file descriptor or a std::istream in chunks,
+ * with the line boundaries of Python's str.splitlines() on UTF-8 text:
+ * "\n", "\r\n", "\r", "\v", "\f", "\x1c" to "\x1e", U+0085, U+2028
+ * and U+2029. Every line is a StringView into a buffer that is reused,
+ * valid until the next line is read. The buffer holds one chunk, or the
+ * longest line when that does not fit, whatever the size of the input.
+ *
+ *     for (auto line : py_str::LineReader(std::cin))
+ *         ...
+ */
+class LineReader {
+public:
+    using size_type = StringView::size_type;
+    static constexpr size_type Default_chunk_size = 64 * 1024;
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = StringView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const StringView*;
+        using reference = const StringView&;
+
+        iterator() = default;
+
+        reference operator*() const noexcept
+        {
+            return line;
+        }
+
+        pointer operator->() const noexcept
+        {
+            return &line;
+        }
+
+        iterator& operator++()
+        {
+            if (!reader->next(line))
+                reader = nullptr;
+            return *this;
+        }
+
+        friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return lhs.reader == rhs.reader;
+        }
+
+        friend bool operator!=(const iterator& lhs, const iterator& rhs) noexcept
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class LineReader;
+
+        explicit iterator(LineReader* reader)
+            : reader(reader)
+        {
+            ++*this;
+        }
+
+        LineReader* reader = nullptr;
+        StringView line {};
+    };
+
+#if defined(PY_STRING_POSIX)
+    /* The descriptor is not closed by the reader */
+    explicit LineReader(int fd, bool keep_line_breaks = false, size_type chunk_size = Default_chunk_size)
+        : fd(fd)
+        , buffer(std::max<size_type>(chunk_size, 1), '\0')
+        , keep_line_breaks(keep_line_breaks)
+    {
+    }
+#endif
+
+    explicit LineReader(std::istream& in, bool keep_line_breaks = false, size_type chunk_size = Default_chunk_size)
+        : in(&in)
+        , buffer(std::max<size_type>(chunk_size, 1), '\0')
+        , keep_line_breaks(keep_line_breaks)
+    {
+    }
+
+    /* Reads the next line into line, returns false at the end of the input */
+    bool next(StringView& line)
+    {
+        for (;;) {
+            size_type length = 0;
+            auto first = buffer.data() + head;
+            auto last = buffer.data() + tail;
+            auto found = detail::find_line_break(buffer.data() + scanned, last, at_end, length);
+            if (found != last && length) {
+                line = StringView(first, static_cast<size_type>(found - first) + (keep_line_breaks ? length : 0));
+                head = scanned = static_cast<size_type>(found - buffer.data()) + length;
+                return true;
+            }
+
+            if (at_end) {
+                if (first == last)
+                    return false;
+                line = StringView(first, static_cast<size_type>(last - first));
+                head = scanned = tail;
+                return true;
+            }
+
+            /* The bytes before found hold no line break, only a "\r" or
+             * a UTF-8 sequence cut by the end of the buffer is searched
+             * again */
+            scanned = static_cast<size_type>(found - buffer.data());
+            refill();
+        }
+    }
+
+    iterator begin()
+    {
+        return iterator(this);
+    }
+
+    iterator end()
+    {
+        return iterator();
+    }
+
+private:
+    /* Moves the unfinished line to the front and reads after it,
+     * growing the buffer when the line fills it */
+    void refill()
+    {
+        if (head) {
+            std::memmove(&buffer[0], buffer.data() + head, tail - head);
+            tail -= head;
+            scanned -= head;
+            head = 0;
+        }
+        if (tail == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        auto count = read(&buffer[tail], buffer.size() - tail);
+        tail += count;
+        at_end = count == 0;
+    }
+
+    size_type read(char* out, size_type size)
+    {
+        if (in) {
+            in->read(out, static_cast<std::streamsize>(size));
+            return static_cast<size_type>(in->gcount());
+        }
+
+#if defined(PY_STRING_POSIX)
+        for (;;) {
+            auto count = ::read(fd, out, size);
+            if (count >= 0)
+                return static_cast<size_type>(count);
+            if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "read");
+        }
+#else
+        return 0;
+#endif
+    }
+
+    std::istream* in = nullptr;
+    int fd = -1;
+    std::string buffer;
+    size_type head = 0;
+    size_type tail = 0;
+    /* Where the search for the end of the line at head resumes */
+    size_type scanned = 0;
+    bool at_end = false;
+    bool keep_line_breaks;
+};
+
+/* Vector with inline storage for at most N elements, usable in constant
+ * expressions. push_back() throws std::length_error when it is full. */
+template <typename T, std::size_t N>
+class FixedVector {
+public:
+    using size_type = std::size_t;
+
+    constexpr FixedVector() = default;
+
+    constexpr size_type size() const noexcept
+    {
+        return count;
+    }
+
+    constexpr bool empty() const noexcept
+    {
+        return count == 0;
+    }
+
+    static constexpr size_type capacity() noexcept
+    {
+        return N;
+    }
+
+    constexpr T& operator[](size_type pos) noexcept
     {
-        return str.empty();
+        return items[pos];
     }
 
-    size_type size() const
+    constexpr const T& operator[](size_type pos) const noexcept
     {
-        return str.size();
+        return items[pos];
     }
 
-    size_type len() const
+    constexpr T* begin() noexcept
     {
-        return size();
+        return items;
     }
 
-    const char* c_str() const
+    constexpr T* end() noexcept
     {
-        return str.c_str();
+        return items + count;
     }
 
-    char& operator[](int pos)
+    constexpr const T* begin() const noexcept
     {
-        return str[str_index(pos)];
+        return items;
     }
 
-    const char& operator[](int pos) const
+    constexpr const T* end() const noexcept
     {
-        return str[str_index(pos)];
+        return items + count;
     }
 
-    const char* begin() const
+    constexpr void push_back(const T& value)
     {
-        return &str[0];
+        if (count == N)
+            throw std::length_error("FixedVector is full");
+        items[count++] = value;
     }
 
-    const char* end() const
+private:
+    T items[N] {};
+    size_type count = 0;
+};
+
+/* String with inline storage for up to N characters, no heap and
+ * constexpr methods, for normalising keys and names at compile time or
+ * for stack strings in hot loops. Exceeding N throws std::length_error,
+ * which is a compile error in a constant expression. */
+template <std::size_t N>
+class FixedString {
+public:
+    using size_type = std::size_t;
+
+    constexpr FixedString() = default;
+
+    template <std::size_t M>
+    constexpr FixedString(const char (&str)[M])
+        : FixedString(StringView(str, M - 1))
     {
-        return &str[size()];
+        static_assert(M - 1 <= N, "string literal does not fit into the FixedString");
     }
 
-    char* begin()
+    constexpr explicit FixedString(StringView str)
     {
-        return &str[0];
+        append(str);
     }
 
-    char* end()
+    constexpr operator StringView() const noexcept
     {
-        return &str[size()];
+        return { buffer, length };
     }
 
-    /* from and to indexes are included */
-    String slice(int from, int to) const
+    constexpr size_type size() const noexcept
     {
-        return from > to ? String() : String(str.substr(str_index(from), str_index(to) + 1));
+        return length;
     }
 
-    String operator()(int from, int to) const
+    constexpr size_type len() const noexcept
     {
-        return slice(from, to);
+        return length;
     }
 
-    String& operator+=(char c)
+    constexpr bool empty() const noexcept
     {
-        str += c;
-        return *this;
+        return length == 0;
     }
 
-    String& operator+=(const char* string)
+    static constexpr size_type capacity() noexcept
     {
-        str += string;
-        return *this;
+        return N;
     }
 
-    String& operator+=(const std::string& string)
+    constexpr const char* c_str() const noexcept
     {
-        str += string;
-        return *this;
+        return buffer;
     }
 
-    String& operator+=(const String& string)
+    constexpr const char* data() const noexcept
     {
-        str += string.str;
-        return *this;
+        return buffer;
     }
 
-    String& insert(int pos, char c)
+    constexpr char& operator[](size_type pos) noexcept
     {
-        str.insert(str_index(pos), 1, c);
-        return *this;
+        return buffer[pos];
     }
 
-    String& insert(int pos, const char* string)
+    constexpr const char& operator[](size_type pos) const noexcept
     {
-        str.insert(str_index(pos), string);
-        return *this;
+        return buffer[pos];
     }
 
-    String& insert(int pos, const String& string)
+    constexpr const char* begin() const noexcept
     {
-        str.insert(str_index(pos), string.c_str());
-        return *this;
+        return buffer;
     }
 
-    String& insert(int pos, const std::string& string)
+    constexpr const char* end() const noexcept
     {
-        str.insert(str_index(pos), string);
-        return *this;
+        return buffer + length;
     }
 
-    String& del(int pos)
+    constexpr FixedString& operator+=(char c)
     {
-        str.erase(str_index(pos), 1);
-        return *this;
+        return append(StringView(&c, 1));
     }
 
-    String& capitalize()
+    constexpr FixedString& operator+=(StringView str)
     {
-        if (empty())
-            return *this;
-
-        str[0] = std::toupper(str[0]);
-        for (unsigned i = 1; i < size(); ++i)
-            str[i] = std::tolower(str[i]);
-
-        return *this;
+        return append(str);
     }
 
-    String& casefold()
+    constexpr bool contains(StringView value) const noexcept
     {
-        for (auto& c : str)
-            c = std::tolower(c);
-        return *this;
+        return find(value) != Not_found;
     }
 
-    bool contains(const char* string) const
+    constexpr bool endswith(StringView value) const noexcept
     {
-        if (!strlen(string))
-            return false;
-
-        return (str.find(string) != Not_found);
+        return value.size() <= length && view().substr(length - value.size()) == std::string_view(value);
     }
 
-    bool contains(const std::string& string) const
+    constexpr size_type find(StringView value) const noexcept
     {
-        if (string.empty())
-            return false;
+        return view().find(std::string_view(value));
+    }
 
-        return (str.find(string) != Not_found);
+    constexpr bool startswith(StringView value) const noexcept
+    {
+        return value.size() <= length && view().substr(0, value.size()) == std::string_view(value);
     }
 
-    bool contains(const String& string) const
+    constexpr FixedString& lower() noexcept
     {
-        if (string.empty())
-            return false;
+        for (size_type i = 0; i < length; ++i)
+            if (buffer[i] >= 'A' && buffer[i] <= 'Z')
+                buffer[i] = static_cast<char>(buffer[i] + 32);
 
-        return (str.find(string.str) != Not_found);
+        return *this;
     }
 
-    size_type count(const char* value, int start_pos = 0) const
+    constexpr FixedString& upper() noexcept
     {
-        if (empty())
-            return 0;
-
-        size_type cnt = 0;
-        size_type pos = str_index(start_pos);
-        auto npos = std::string::npos;
-        while (pos != npos) {
-            pos = str.find(value, pos);
-            if (pos != npos) {
-                ++cnt;
-                pos += strlen(value);
-            }
-        }
+        for (size_type i = 0; i < length; ++i)
+            if (buffer[i] >= 'a' && buffer[i] <= 'z')
+                buffer[i] = static_cast<char>(buffer[i] - 32);
 
-        return cnt;
+        return *this;
     }
 
-    size_type count(const String& value, int start_pos = 0) const
+    constexpr FixedString& lstrip(const char ch = ' ') noexcept
     {
-        return count(value.c_str(), start_pos);
+        return lstrip(StringView(&ch, 1));
     }
 
-    size_type count(const std::string& value, int start_pos = 0) const
+    constexpr FixedString& lstrip(StringView chars) noexcept
     {
-        return count(value.c_str(), start_pos);
+        auto pos = view().find_first_not_of(std::string_view(chars));
+        return assign(pos == Not_found ? length : pos, length);
     }
 
-    bool endswith(const char* value) const
+    constexpr FixedString& rstrip(const char ch = ' ') noexcept
     {
-        return str.rfind(value) == str.size() - strlen(value);
+        return rstrip(StringView(&ch, 1));
     }
 
-    bool endswith(const std::string& value) const
+    constexpr FixedString& rstrip(StringView chars) noexcept
     {
-        return str.rfind(value) == str.size() - value.size();
+        auto pos = view().find_last_not_of(std::string_view(chars));
+        return assign(0, pos == Not_found ? 0 : pos + 1);
     }
 
-    bool endswith(const String& value) const
+    constexpr FixedString& strip(const char ch = ' ') noexcept
     {
-        return str.rfind(value.c_str()) == str.size() - value.size();
+        return strip(StringView(&ch, 1));
     }
 
-    size_type find(const char* value) const
+    constexpr FixedString& strip(StringView chars) noexcept
     {
-        return str.find(value);
+        rstrip(chars);
+        return lstrip(chars);
     }
 
-    size_type find(const std::string& value) const
+    /* Replaces the first count occurrences of oldvalue, all when count
+     * is negative. Matches are found before anything is written. */
+    constexpr FixedString& replace(StringView oldvalue, StringView newvalue, int count = -1)
     {
-        return str.find(value);
+        FixedString result;
+        if (oldvalue.empty()) {
+            /* Python inserts newvalue before every character and at the end */
+            size_type copied = 0;
+            for (; copied <= length && count != 0; ++copied, --count) {
+                result.append(newvalue);
+                if (copied < length)
+                    result += buffer[copied];
+            }
+            if (copied < length)
+                result.append(StringView(buffer + copied, length - copied));
+            return *this = result;
+        }
+
+        size_type pos = 0;
+        for (auto match = find(oldvalue); match != Not_found && count != 0; match = view().find(std::string_view(oldvalue), pos), --count) {
+            result.append(StringView(buffer + pos, match - pos)).append(newvalue);
+            pos = match + oldvalue.size();
+        }
+        result.append(StringView(buffer + pos, length - pos));
+        return *this = result;
     }
 
-    size_type find(const String& value) const
+    /* Splits on runs of whitespace into at most Parts strings */
+    template <std::size_t Parts = 16>
+    constexpr FixedVector<FixedString, Parts> split(int maxsplit = -1) const
     {
-        return str.find(value.str);
+        FixedVector<FixedString, Parts> result;
+        size_type pos = 0;
+        for (;;) {
+            while (pos < length && detail::is_space(static_cast<unsigned char>(buffer[pos])))
+                ++pos;
+            if (pos == length)
+                break;
+
+            /* Once maxsplit is used up the rest is one part, trailing
+             * whitespace included, like Python */
+            auto last = length;
+            if (maxsplit-- != 0) {
+                last = pos;
+                while (last < length && !detail::is_space(static_cast<unsigned char>(buffer[last])))
+                    ++last;
+            }
+            result.push_back(FixedString(StringView(buffer + pos, last - pos)));
+            pos = last;
+        }
+
+        return result;
     }
 
-    size_type index(const char* value) const
+    /* Splits on sep into at most Parts strings */
+    template <std::size_t Parts = 16>
+    constexpr FixedVector<FixedString, Parts> split(StringView sep, int maxsplit = -1) const
     {
-        return find(value);
+        if (sep.empty())
+            throw std::invalid_argument("empty separator");
+
+        FixedVector<FixedString, Parts> result;
+        size_type pos = 0;
+        for (auto match = find(sep); match != Not_found && maxsplit != 0; match = view().find(std::string_view(sep), pos), --maxsplit) {
+            result.push_back(FixedString(StringView(buffer + pos, match - pos)));
+            pos = match + sep.size();
+        }
+        result.push_back(FixedString(StringView(buffer + pos, length - pos)));
+        return result;
     }
 
-    size_type index(const std::string& value) const
+    /* Concatenates the parts with this string between them into a
+     * FixedString of the given capacity */
+    template <std::size_t Capacity = N, typename Range>
+    constexpr FixedString<Capacity> join(const Range& parts) const
     {
-        return find(value);
+        FixedString<Capacity> result;
+        auto first = true;
+        for (const auto& part : parts) {
+            if (!first)
+                result += *this;
+            result += StringView(part);
+            first = false;
+        }
+
+        return result;
     }
 
-    size_type index(const String& value) const
+private:
+    constexpr std::string_view view() const noexcept
     {
-        return find(value);
+        return { buffer, length };
     }
 
-    bool isalpha() const
+    constexpr FixedString& append(StringView str)
     {
-        if (empty())
-            return false;
-
-        for (auto c : str)
-            if (!std::isalpha(c))
-                return false;
+        if (str.size() > N - length)
+            throw std::length_error("FixedString capacity exceeded");
 
-        return true;
+        for (size_type i = 0; i < str.size(); ++i)
+            buffer[length + i] = str.data()[i];
+        length += str.size();
+        buffer[length] = '\0';
+        return *this;
     }
 
-    bool isdigit() const
+    /* Keeps [first, last), moving it to the front */
+    constexpr FixedString& assign(size_type first, size_type last) noexcept
     {
-        if (empty())
-            return false;
-
-        for (auto c : str)
-            if (!std::isdigit(c))
-                return false;
-
-        return true;
+        for (size_type i = first; i < last; ++i)
+            buffer[i - first] = buffer[i];
+        length = last - first;
+        buffer[length] = '\0';
+        return *this;
     }
 
-    bool isalnum() const
-    {
-        if (empty())
-            return false;
+    char buffer[N + 1] {};
+    size_type length = 0;
+};
 
-        for (auto c : str)
-            if (!std::isalnum(c))
-                return false;
+template <std::size_t M>
+FixedString(const char (&)[M]) -> FixedString<M - 1>;
+
+namespace detail {
+
+/* Parsed [[fill]align][sign][#][0][width][grouping][.precision][type] */
+struct Format_spec {
+    char fill = ' ';
+    char align = '\0';
+    char sign = '-';
+    bool alternate = false;
+    char grouping = '\0';
+    std::size_t width = 0;
+    int precision = -1;
+    char type = '\0';
+};
 
-        return true;
-    }
+enum class Format_kind {
+    String,
+    Bool,
+    Integer,
+    Float,
+};
 
-    bool islower() const
-    {
-        if (empty())
-            return false;
+template <typename T>
+constexpr Format_kind format_kind() noexcept
+{
+    if constexpr (std::is_same<T, bool>::value)
+        return Format_kind::Bool;
+    else if constexpr (std::is_same<T, char>::value)
+        return Format_kind::String;
+    else if constexpr (std::is_integral<T>::value)
+        return Format_kind::Integer;
+    else if constexpr (std::is_floating_point<T>::value)
+        return Format_kind::Float;
+    else {
+        static_assert(std::is_convertible<const T&, StringView>::value, "format() argument must be a number or a string");
+        return Format_kind::String;
+    }
+}
 
-        bool contains_lower = false;
+constexpr bool is_format_align(char c) noexcept
+{
+    return c == '<' || c == '>' || c == '^' || c == '=';
+}
 
-        for (auto c : str) {
-            contains_lower |= std::islower(c);
-            if (!std::islower(c) && !std::isdigit(c) && !std::isspace(c) && !std::ispunct(c))
-                return false;
-        }
+constexpr bool is_format_digit(char c) noexcept
+{
+    return c >= '0' && c <= '9';
+}
 
-        return contains_lower;
+constexpr const char* parse_format_number(const char* first, const char* last, std::size_t& value)
+{
+    value = 0;
+    for (; first != last && is_format_digit(*first); ++first) {
+        value = value * 10 + static_cast<std::size_t>(*first - '0');
+        if (value > 0xffff)
+            throw std::invalid_argument("too many decimal digits in format string");
     }
+    return first;
+}
 
-    bool isupper() const
-    {
-        if (empty())
-            return false;
+constexpr const char* parse_format_spec(const char* first, const char* last, Format_spec& spec)
+{
+    bool fill = false;
+    if (last - first >= 2 && is_format_align(first[1]) && first[0] != '{' && first[0] != '}') {
+        spec.fill = first[0];
+        spec.align = first[1];
+        fill = true;
+        first += 2;
+    } else if (first != last && is_format_align(*first)) {
+        spec.align = *first++;
+    }
 
-        bool contains_upper = false;
+    if (first != last && (*first == '+' || *first == '-' || *first == ' '))
+        spec.sign = *first++;
 
-        for (auto c : str) {
-            contains_upper |= std::isupper(c);
-            if (!std::isupper(c) && !std::isdigit(c) && !std::isspace(c) && !std::ispunct(c))
-                return false;
-        }
+    if (first != last && *first == '#') {
+        spec.alternate = true;
+        ++first;
+    }
 
-        return contains_upper;
+    if (first != last && *first == '0') {
+        if (!fill)
+            spec.fill = '0';
+        if (!spec.align)
+            spec.align = '=';
+        ++first;
     }
 
-    bool isspace() const
-    {
-        if (empty())
-            return false;
+    first = parse_format_number(first, last, spec.width);
 
-        for (auto c : str) {
-            if (!std::isspace(c))
-                return false;
-        }
+    if (first != last && (*first == ',' || *first == '_'))
+        spec.grouping = *first++;
 
-        return true;
+    if (first != last && *first == '.') {
+        std::size_t precision = 0;
+        auto digits = ++first;
+        first = parse_format_number(first, last, precision);
+        if (first == digits)
+            throw std::invalid_argument("format specifier missing precision");
+        spec.precision = static_cast<int>(precision);
     }
 
-    String& join(const String& string)
-    {
-        auto joiner { str };
-        str.clear();
-        auto last = string.size() - 1;
-        for (unsigned i = 0; i < string.size(); ++i) {
-            str += string[i];
-            if (i != last)
-                str += joiner;
+    if (first != last && *first != '}') {
+        constexpr const char types[] = "bcdeEfFgGnosxX%";
+        for (auto type : types) {
+            if (type && type == *first) {
+                spec.type = *first++;
+                break;
+            }
         }
-
-        return *this;
+        if (first != last && *first != '}')
+            throw std::invalid_argument("invalid format specifier");
     }
 
-    String& join(const std::vector<String>& strings)
-    {
-        if (strings.empty()) {
-            str.clear();
-            return *this;
+    return first;
+}
+
+/* Calls handler.literal(first, last) for the text between fields and
+ * handler.field(index, spec) for every replacement field. Shared by the
+ * compile-time check and by the writer, so they cannot disagree. */
+template <typename Handler>
+constexpr void parse_format(const char* first, const char* last, std::size_t args, Handler& handler)
+{
+    std::size_t next_arg = 0;
+    bool automatic = false;
+    bool manual = false;
+    auto literal = first;
+    while (first != last) {
+        if (*first == '}') {
+            if (last - first < 2 || first[1] != '}')
+                throw std::invalid_argument("single '}' encountered in format string");
+            handler.literal(literal, first + 1);
+            first += 2;
+            literal = first;
+            continue;
         }
 
-        if (strings.size() == 1)
-            return join(strings[0]);
+        if (*first != '{') {
+            ++first;
+            continue;
+        }
 
-        auto joiner { str };
-        str.clear();
-        auto last = strings.size() - 1;
-        for (unsigned i = 0; i < strings.size(); ++i) {
-            str += strings[i].str;
-            if (i != last)
-                str += joiner;
+        if (last - first >= 2 && first[1] == '{') {
+            handler.literal(literal, first + 1);
+            first += 2;
+            literal = first;
+            continue;
         }
 
-        return *this;
+        handler.literal(literal, first++);
+        std::size_t index = 0;
+        if (first != last && is_format_digit(*first)) {
+            first = parse_format_number(first, last, index);
+            manual = true;
+        } else {
+            index = next_arg++;
+            automatic = true;
+        }
+        if (automatic && manual)
+            throw std::invalid_argument("cannot switch between automatic and manual field numbering");
+
+        Format_spec spec;
+        if (first != last && *first == ':')
+            first = parse_format_spec(first + 1, last, spec);
+        if (first == last || *first != '}')
+            throw std::invalid_argument("expected '}' in format string");
+        if (index >= args)
+            throw std::invalid_argument("format argument index out of range");
+
+        handler.field(index, spec);
+        literal = ++first;
     }
 
-    String& lower()
-    {
-        return casefold();
+    handler.literal(literal, last);
+}
+
+constexpr void check_format_spec(const Format_spec& spec, Format_kind kind)
+{
+    auto type = spec.type;
+    if (kind == Format_kind::Bool)
+        kind = type || spec.align || spec.width || spec.sign != '-' || spec.grouping ? Format_kind::Integer : Format_kind::String;
+
+    if (kind == Format_kind::String) {
+        if (type && type != 's')
+            throw std::invalid_argument("unknown format code for a string argument");
+        if (spec.sign != '-' || spec.alternate || spec.grouping || spec.align == '=')
+            throw std::invalid_argument("sign, '#', grouping and '=' are not allowed with strings");
+    } else if (kind == Format_kind::Integer) {
+        if (type && !(type == 'b' || type == 'c' || type == 'd' || type == 'n' || type == 'o' || type == 'x' || type == 'X'))
+            throw std::invalid_argument("unknown format code for an integer argument");
+        if (spec.precision >= 0)
+            throw std::invalid_argument("precision not allowed in integer format specifier");
+        if (spec.grouping && (type == 'c' || type == 'n' || (spec.grouping == ',' && type && type != 'd')))
+            throw std::invalid_argument("cannot combine this grouping with this format code");
+        if (type == 'c' && (spec.sign != '-' || spec.alternate))
+            throw std::invalid_argument("sign and '#' not allowed with format code 'c'");
+    } else {
+        if (type && !(type == 'e' || type == 'E' || type == 'f' || type == 'F' || type == 'g' || type == 'G' || type == 'n' || type == '%'))
+            throw std::invalid_argument("unknown format code for a float argument");
+        if (spec.alternate)
+            throw std::invalid_argument("'#' is not supported with floats");
+        if (spec.grouping && type == 'n')
+            throw std::invalid_argument("cannot combine grouping with format code 'n'");
     }
+}
 
-    String& replace(const char* oldvalue, const char* newvalue)
-    {
-        for (size_type pos = 0; str.npos != (pos = str.find(oldvalue, pos, strlen(oldvalue))); pos += strlen(newvalue)) {
-            str.replace(pos, strlen(oldvalue), newvalue, strlen(newvalue));
-        }
+/* A literal piece of the format string or a replacement field */
+struct Format_item {
+    static constexpr std::uint16_t Literal = 0xffff;
 
-        return *this;
-    }
+    std::uint16_t index = Literal;
+    std::uint16_t first = 0;
+    std::uint16_t last = 0;
+    Format_spec spec;
+};
 
-    size_type rfind(const char* value) const
+/* The items of a checked format string, so that formatting replays them
+ * instead of parsing the string again. Strings with more items, or
+ * longer than the 16-bit offsets, are parsed again on every call. */
+struct Parsed_format {
+    static constexpr std::size_t Capacity = 16;
+
+    constexpr void add(const Format_item& item) noexcept
     {
-        return str.rfind(value);
+        if (complete && size < Capacity)
+            items[size++] = item;
+        else
+            complete = false;
     }
 
-    size_type rfind(const std::string& value) const
+    Format_item items[Capacity] {};
+    std::size_t size = 0;
+    bool complete = true;
+};
+
+/* Checks every field against the argument types and records the items */
+struct Format_checker {
+    const Format_kind* kinds;
+    const char* text;
+    Parsed_format& parsed;
+
+    constexpr void literal(const char* first, const char* last) noexcept
     {
-        return str.rfind(value);
+        if (first == last)
+            return;
+        if (static_cast<std::size_t>(last - text) >= Format_item::Literal)
+            parsed.complete = false;
+        else
+            parsed.add({ Format_item::Literal, static_cast<std::uint16_t>(first - text), static_cast<std::uint16_t>(last - text), {} });
     }
 
-    size_type rfind(const String& value) const
+    constexpr void field(std::size_t index, const Format_spec& spec)
     {
-        return str.rfind(value.str);
+        check_format_spec(spec, kinds[index]);
+        parsed.add({ static_cast<std::uint16_t>(index), 0, 0, spec });
     }
+};
 
-    size_type rindex(const char* value) const
+/* Arguments with their type erased, so that fields can pick them by
+ * index at run time */
+struct Format_arg {
+    Format_kind kind;
+    StringView string;
+    long long integer = 0;
+    unsigned long long uinteger = 0;
+    double number = 0;
+    bool boolean = false;
+    bool is_unsigned = false;
+
+    template <typename T>
+    Format_arg(const T& value) noexcept
+        : kind(format_kind<std::decay_t<T>>())
     {
-        return rfind(value);
+        if constexpr (std::is_same<T, bool>::value) {
+            boolean = value;
+        } else if constexpr (std::is_same<T, char>::value) {
+            string = StringView(&value, 1);
+        } else if constexpr (std::is_integral<T>::value && std::is_unsigned<T>::value) {
+            uinteger = value;
+            is_unsigned = true;
+        } else if constexpr (std::is_integral<T>::value) {
+            integer = value;
+        } else if constexpr (std::is_floating_point<T>::value) {
+            number = static_cast<double>(value);
+        } else {
+            string = StringView(value);
+        }
     }
+};
 
-    size_type rindex(const std::string& value) const
+template <typename String>
+class Format_writer {
+public:
+    Format_writer(String& out, const Format_arg* args) noexcept
+        : out(out)
+        , args(args)
     {
-        return rfind(value);
     }
 
-    size_type rindex(const String& value) const
+    void literal(const char* first, const char* last)
     {
-        return rfind(value);
+        out.append(first, static_cast<std::size_t>(last - first));
     }
 
-    std::vector<String> split()
+    void field(std::size_t index, const Format_spec& spec)
     {
-        std::vector<String> result;
-
-        if (empty())
-            return result;
-
-        String string(str);
-        string.strip();
-
-        for (auto from = string.begin(), to = string.end();
-             from < to;
-             (from = std::find_if(
-                  from, to, [](char c) { return std::isalnum(c); }))) {
-            auto pos = std::find_if(from, to, [](char c) { return std::isspace(c); });
-            result.emplace_back(std::string(from, pos));
-
-            from = pos;
+        auto& arg = args[index];
+        auto start = out.size();
+        std::size_t prefix = 0;
+        auto align = '>';
+        switch (arg.kind) {
+        case Format_kind::Bool:
+            if (!spec.type && !spec.align && !spec.width && spec.sign == '-' && !spec.grouping) {
+                write_string(arg.boolean ? "True" : "False", spec);
+                align = '<';
+            } else {
+                prefix = write_integer(arg.boolean, false, spec);
+            }
+            break;
+        case Format_kind::Integer:
+            prefix = arg.is_unsigned ? write_integer(arg.uinteger, false, spec)
+                                     : write_integer(magnitude(arg.integer), arg.integer < 0, spec);
+            break;
+        case Format_kind::Float:
+            prefix = write_float(arg.number, spec);
+            break;
+        case Format_kind::String:
+            write_string(arg.string, spec);
+            align = '<';
+            break;
         }
 
-        return result;
+        pad(start, prefix, spec, spec.align ? spec.align : align);
     }
 
-    std::vector<String> splitlines(bool keep_line_breaks = false)
+private:
+    static unsigned long long magnitude(long long value) noexcept
     {
-        std::vector<String> result;
-
-        if (empty())
-            return result;
-
-        for (auto from = str.begin(), to = str.end(); from < to;) {
-            auto pos = std::find_if(from, to, [](char c) { return c == '\n'; });
-            result.emplace_back(std::string(from, keep_line_breaks ? pos + 1 : pos));
-            from = pos + 1;
-        }
-
-        return result;
+        return value < 0 ? 0 - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
     }
 
-    bool startswith(const char* value) const
+    char* room(std::size_t pos, std::size_t size)
     {
-        return str.find(value) == 0;
+        out.resize(pos + size);
+        return &out[pos];
     }
 
-    bool startswith(const std::string& value) const
+    void write_string(StringView string, const Format_spec& spec)
     {
-        return str.find(value) == 0;
+        auto size = spec.precision >= 0 ? std::min(string.size(), static_cast<std::size_t>(spec.precision)) : string.size();
+        out.append(string.data(), size);
     }
 
-    bool startswith(const String& value) const
+    /* Sign and base prefix, returns their length */
+    std::size_t write_sign(bool negative, char sign, const char* prefix)
     {
-        return str.find(value.c_str()) == 0;
+        auto start = out.size();
+        if (negative)
+            out.push_back('-');
+        else if (sign != '-')
+            out.push_back(sign);
+        out.append(prefix);
+        return out.size() - start;
     }
 
-    String& lstrip(const char ch = ' ')
+    std::size_t write_integer(unsigned long long value, bool negative, const Format_spec& spec)
     {
-        if (empty())
-            return *this;
+        if (spec.type == 'c') {
+            write_code_point(negative ? ~0ull : value);
+            return 0;
+        }
 
-        auto pos = str.find_first_not_of(ch);
-        if (pos != Not_found && pos != 0) {
-            auto sz = size() - pos;
-            str.replace(0, size(), str.c_str() + pos, sz);
-        } else if (pos == Not_found && str.find_first_of(ch) != Not_found) {
-            str.clear();
+        auto base = 10;
+        auto prefix = "";
+        switch (spec.type) {
+        case 'b':
+            base = 2;
+            prefix = "0b";
+            break;
+        case 'o':
+            base = 8;
+            prefix = "0o";
+            break;
+        case 'x':
+            base = 16;
+            prefix = "0x";
+            break;
+        case 'X':
+            base = 16;
+            prefix = "0X";
+            break;
         }
 
-        return *this;
+        auto sign = write_sign(negative, spec.sign, spec.alternate ? prefix : "");
+        auto pos = out.size();
+        auto first = room(pos, 64);
+        auto last = std::to_chars(first, first + 64, value, base).ptr;
+        if (spec.type == 'X')
+            std::transform(first, last, first, [](char c) { return c >= 'a' && c <= 'z' ? static_cast<char>(c - 32) : c; });
+        out.resize(pos + static_cast<std::size_t>(last - first));
+        if (spec.grouping)
+            group(pos, out.size(), base == 10 ? 3 : 4, spec.grouping);
+
+        return sign;
     }
 
-    String& lstrip(const char* string)
+    void write_code_point(unsigned long long code)
     {
-        if (empty())
-            return *this;
-
-        auto pos = str.find_first_not_of(string);
-        if (pos != Not_found && pos != 0) {
-            auto sz = size() - pos;
-            str.replace(0, size(), str.c_str() + pos, sz);
-        } else if (pos == Not_found && str.find_first_of(string) != Not_found) {
-            str.clear();
+        if (code > 0x10ffff)
+            throw std::out_of_range("format code 'c' argument not in range(0x110000)");
+
+        auto c = static_cast<std::uint32_t>(code);
+        if (c < 0x80) {
+            out.push_back(static_cast<char>(c));
+        } else if (c < 0x800) {
+            out.push_back(static_cast<char>(0xc0 | (c >> 6)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else if (c < 0x10000) {
+            out.push_back(static_cast<char>(0xe0 | (c >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else {
+            out.push_back(static_cast<char>(0xf0 | (c >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3f)));
         }
-
-        return *this;
     }
 
-    String& lstrip(const std::string& string)
+    std::size_t write_float(double value, const Format_spec& spec)
     {
-        if (empty())
-            return *this;
+        auto nan = std::isnan(value);
+        auto sign = write_sign(!nan && std::signbit(value), spec.sign, "");
+        value = std::fabs(value);
+
+        auto type = spec.type;
+        auto precision = spec.precision;
+        if (type == '%')
+            value *= 100;
+
+        auto pos = out.size();
+        std::size_t size = 32 + static_cast<std::size_t>(precision > 0 ? precision : 0);
+        for (;;) {
+            auto first = room(pos, size);
+            auto result = to_chars(first, first + size, value, type, precision);
+            if (result.ec == std::errc()) {
+                out.resize(pos + static_cast<std::size_t>(result.ptr - first));
+                break;
+            }
+            size *= 2;
+        }
 
-        auto pos = str.find_first_not_of(string);
-        if (pos != Not_found && pos != 0) {
-            auto sz = size() - pos;
-            str.replace(0, size(), str.c_str() + pos, sz);
-        } else if (pos == Not_found && str.find_first_of(string) != Not_found) {
-            str.clear();
+        auto first = &out[pos];
+        auto last = first + (out.size() - pos);
+        if (type == 'E' || type == 'F' || type == 'G')
+            std::transform(first, last, first, [](char c) { return c >= 'a' && c <= 'z' ? static_cast<char>(c - 32) : c; });
+        if (!type && std::isfinite(value) && std::find_if(first, last, [](char c) { return c == '.' || c == 'e'; }) == last)
+            out.append(".0");
+        if (type == '%')
+            out.push_back('%');
+
+        if (spec.grouping && std::isfinite(value)) {
+            auto digits = static_cast<std::size_t>(std::find_if(out.data() + pos, out.data() + out.size(), [](char c) { return !is_format_digit(c); }) - out.data());
+            group(pos, digits, 3, spec.grouping);
         }
 
-        return *this;
+        return sign;
     }
 
-    String& lstrip(const String& string)
+    /* Python's float formatting on top of the shortest round trip and
+     * fixed precision conversions of std::to_chars */
+    static std::to_chars_result to_chars(char* first, char* last, double value, char type, int precision)
     {
-        if (empty())
-            return *this;
-
-        auto pos = str.find_first_not_of(string.str);
-        if (pos != Not_found && pos != 0) {
-            auto sz = size() - pos;
-            str.replace(0, size(), str.c_str() + pos, sz);
-        } else if (pos == Not_found && str.find_first_of(string.str) != Not_found) {
-            str.clear();
+        switch (type) {
+        case 'e':
+        case 'E':
+            return std::to_chars(first, last, value, std::chars_format::scientific, precision >= 0 ? precision : 6);
+        case 'f':
+        case 'F':
+        case '%':
+            return std::to_chars(first, last, value, std::chars_format::fixed, precision >= 0 ? precision : 6);
+        case 'g':
+        case 'G':
+        case 'n':
+            return std::to_chars(first, last, value, std::chars_format::general, precision > 0 ? precision : precision ? 6 : 1);
         }
 
-        return *this;
+        if (precision >= 0)
+            return std::to_chars(first, last, value, std::chars_format::general, precision ? precision : 1);
+        if (value != 0 && (value < 1e-4 || value >= 1e16))
+            return std::to_chars(first, last, value, std::chars_format::scientific);
+        return std::to_chars(first, last, value, std::chars_format::fixed);
     }
 
-    String& rstrip(const char ch = ' ')
+    /* Inserts a separator every group digits of [first, last) */
+    void group(std::size_t first, std::size_t last, std::size_t every, char separator)
     {
-        if (empty())
-            return *this;
-
-        auto pos = str.find_last_not_of(ch);
-        if (pos != Not_found) {
-            str.resize(pos + 1);
-        } else if (str.find_first_of(ch) != Not_found) {
-            str.clear();
+        auto digits = last - first;
+        if (digits <= every)
+            return;
+
+        auto separators = (digits - 1) / every;
+        auto tail = out.size() - last;
+        out.resize(out.size() + separators);
+        auto data = &out[0];
+        std::memmove(data + last + separators, data + last, tail);
+        auto from = last;
+        auto to = last + separators;
+        for (std::size_t count = 0; from != first; ++count) {
+            if (count && count % every == 0)
+                data[--to] = separator;
+            data[--to] = data[--from];
         }
-
-        return *this;
     }
 
-    String& rstrip(const char* string)
+    void pad(std::size_t start, std::size_t prefix, const Format_spec& spec, char align)
     {
-        if (empty())
-            return *this;
-
-        auto pos = str.find_last_not_of(string);
-        if (pos != Not_found) {
-            str.resize(pos + 1);
-        } else if (str.find_first_of(string) != Not_found) {
-            str.clear();
+        auto size = out.size() - start;
+        if (spec.width <= size)
+            return;
+
+        auto padding = spec.width - size;
+        auto before = align == '<' ? 0 : align == '^' ? padding / 2 : padding;
+        if (align == '=') {
+            start += prefix;
+            size -= prefix;
         }
 
-        return *this;
+        out.resize(out.size() + padding);
+        auto data = &out[start];
+        std::memmove(data + before, data, size);
+        std::memset(data, spec.fill, before);
+        std::memset(data + before + size, spec.fill, padding - before);
     }
 
-    String& rstrip(const std::string& string)
-    {
-        if (empty())
-            return *this;
+    String& out;
+    const Format_arg* args;
+};
 
-        auto pos = str.find_last_not_of(string);
-        if (pos != Not_found) {
-            str.resize(pos + 1);
-        } else if (str.find_first_of(string) != Not_found) {
-            str.clear();
-        }
+/* Upper bound for most fields, used to reserve the output once */
+struct Format_estimator {
+    const Format_arg* args;
+    std::size_t size = 0;
 
-        return *this;
+    void literal(const char* first, const char* last) noexcept
+    {
+        size += static_cast<std::size_t>(last - first);
     }
 
-    String& rstrip(const String& string)
+    void field(std::size_t index, const Format_spec& spec) noexcept
     {
-        if (empty())
-            return *this;
-
-        auto pos = str.find_last_not_of(string.str);
-        if (pos != Not_found) {
-            str.resize(pos + 1);
-        } else if (str.find_first_of(string.str) != Not_found) {
-            str.clear();
+        auto& arg = args[index];
+        std::size_t estimate = 0;
+        switch (arg.kind) {
+        case Format_kind::String:
+            estimate = spec.precision >= 0 ? std::min(arg.string.size(), static_cast<std::size_t>(spec.precision)) : arg.string.size();
+            break;
+        case Format_kind::Bool:
+            estimate = 5;
+            break;
+        case Format_kind::Integer:
+            estimate = spec.type == 'b' ? 67 + (spec.grouping ? 16 : 0) : 28;
+            break;
+        case Format_kind::Float:
+            estimate = 26 + static_cast<std::size_t>(spec.precision > 0 ? spec.precision : 0);
+            break;
         }
-
-        return *this;
+        size += std::max(estimate, spec.width);
     }
+};
 
-    String& strip(const char ch = ' ')
-    {
-        lstrip(ch);
-        rstrip(ch);
+template <typename Handler>
+void replay_format(StringView text, const Parsed_format& parsed, Handler& handler)
+{
+    for (std::size_t i = 0; i < parsed.size; ++i) {
+        auto& item = parsed.items[i];
+        if (item.index == Format_item::Literal)
+            handler.literal(text.data() + item.first, text.data() + item.last);
+        else
+            handler.field(item.index, item.spec);
+    }
+}
 
-        return *this;
+/* Estimates the size, reserves it once and writes the fields */
+template <typename String>
+void write_format(String& out, StringView text, const Parsed_format& parsed, const Format_arg* args, std::size_t count)
+{
+    Format_estimator estimator { args };
+    Format_writer<String> writer(out, args);
+    if (parsed.complete) {
+        replay_format(text, parsed, estimator);
+        out.reserve(out.size() + estimator.size);
+        replay_format(text, parsed, writer);
+    } else {
+        parse_format(text.begin(), text.end(), count, estimator);
+        out.reserve(out.size() + estimator.size);
+        parse_format(text.begin(), text.end(), count, writer);
     }
+}
 
-    String& strip(const char* string)
-    {
-        lstrip(string);
-        rstrip(string);
+template <typename T>
+struct Identity {
+    using type = T;
+};
 
-        return *this;
-    }
+/* Base of the sources made by PY_STRING_FORMAT */
+struct Format_source {
+};
 
-    String& strip(const std::string& string)
-    {
-        lstrip(string);
-        rstrip(string);
+template <typename Source, typename... Args>
+struct Compiled_format;
 
-        return *this;
-    }
+}
 
-    String& strip(const String& string)
+/* Format string checked against the types of the arguments when it is
+ * constructed, which also records its fields for formatting. The
+ * constructor is consteval when the compiler supports it, so a bad
+ * format string fails to compile. In C++17 it is checked at compile time
+ * when declared constexpr or passed through PY_STRING_FORMAT, and at run
+ * time otherwise. */
+template <typename... Args>
+class Format_string {
+public:
+    template <std::size_t N>
+    PY_STRING_CONSTEVAL Format_string(const char (&fmt)[N])
+        : fmt(fmt, N - 1)
     {
-        lstrip(string);
-        rstrip(string);
-
-        return *this;
+        constexpr detail::Format_kind kinds[] = { detail::format_kind<Args>()..., detail::Format_kind::String };
+        detail::Format_checker checker { kinds, fmt, parsed };
+        detail::parse_format(fmt, fmt + N - 1, sizeof...(Args), checker);
     }
 
-    String& swapcase()
+    constexpr StringView get() const noexcept
     {
-        for (auto& c : str) {
-            if (std::isupper(c)) {
-                c = std::tolower(c);
-            } else if (std::islower(c)) {
-                c = std::toupper(c);
-            }
-        }
-
-        return *this;
+        return fmt;
     }
 
-    String& upper()
+    constexpr const detail::Parsed_format& fields() const noexcept
     {
-        for (auto& c : str)
-            c = std::toupper(c);
-        return *this;
+        return parsed;
     }
 
-    String& zfill(size_type len)
-    {
-        if (len < size())
-            return *this;
+private:
+    StringView fmt;
+    detail::Parsed_format parsed;
+};
 
-        auto sz = size();
-        str.resize(len);
-        str.replace(len - sz, sz, str.c_str(), sz);
-        for (unsigned i = 0; i < len - sz; ++i)
-            str[i] = '0';
+template <typename... Args>
+using Format_string_for = typename detail::Identity<Format_string<std::decay_t<Args>...>>::type;
 
-        return *this;
-    }
+namespace detail {
 
-    std::string str {};
+template <typename Source, typename... Args>
+struct Compiled_format {
+    static constexpr Format_string<Args...> value { Source::text() };
 };
 
-bool operator==(const String& lhs, const String& rhs)
-{
-    return lhs.str == rhs.str;
-}
+template <typename Source>
+using Enable_if_format_source = std::enable_if_t<std::is_base_of<Format_source, Source>::value, int>;
 
-std::ostream& operator<<(std::ostream& out, const String& string)
-{
-    out << string.str;
-    return out;
 }
 
-String operator+(const String& lhs, const String& rhs)
+/* A format string literal that is checked at compile time in C++17 as
+ * well: format(PY_STRING_FORMAT("{}: {:.3f}"), name, load) */
+#define PY_STRING_FORMAT(s)                                 \
+    [] {                                                    \
+        struct Source : py_str::detail::Format_source {     \
+            static constexpr auto& text() noexcept          \
+            {                                               \
+                return s;                                   \
+            }                                               \
+        };                                                  \
+        return Source {};                                   \
+    }()
+
+/* Python's str.format() with format specs, appended to out. The size is
+ * estimated first, and numbers are written with std::to_chars straight
+ * into the buffer of out. */
+template <typename Allocator, typename... Args>
+BasicString<Allocator>& format_to(BasicString<Allocator>& out, Format_string_for<Args...> fmt, const Args&... args)
 {
-    return String(lhs.str + rhs.str);
+    const detail::Format_arg erased[] = { detail::Format_arg(args)..., detail::Format_arg(0) };
+    detail::write_format(out.str, fmt.get(), fmt.fields(), erased, sizeof...(Args));
+    return out;
 }
 
-String operator+(const String& lhs, const std::string& rhs)
+template <typename Allocator, typename Source, typename... Args, detail::Enable_if_format_source<Source> = 0>
+BasicString<Allocator>& format_to(BasicString<Allocator>& out, Source, const Args&... args)
 {
-    return String(lhs.str + rhs);
+    constexpr auto& fmt = detail::Compiled_format<Source, std::decay_t<Args>...>::value;
+    const detail::Format_arg erased[] = { detail::Format_arg(args)..., detail::Format_arg(0) };
+    detail::write_format(out.str, fmt.get(), fmt.fields(), erased, sizeof...(Args));
+    return out;
 }
 
-String operator+(const String& lhs, const char& rhs)
+template <typename... Args>
+String format(Format_string_for<Args...> fmt, const Args&... args)
 {
-    return String(lhs.str + rhs);
+    String result;
+    format_to(result, fmt, args...);
+    return result;
 }
 
-String operator+(const char lhs, const String& rhs)
+template <typename Source, typename... Args, detail::Enable_if_format_source<Source> = 0>
+String format(Source source, const Args&... args)
 {
-    return String(lhs + rhs.str);
+    String result;
+    format_to(result, source, args...);
+    return result;
 }
 
 }
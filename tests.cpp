@@ -2,11 +2,122 @@
 #include "doctest.h"
 #include "py_string.h"
 
+#include <cmath>
 #include <cstdio>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <thread>
 
 using namespace py_str;
 
+/* Heap allocations made through the global operator new by the current
+ * thread while count_allocations() runs its function. Every allocator
+ * the library uses by default ends up there. */
+struct Allocations {
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+
+    /* Compared against a budget of allocations, so a failed check
+     * prints both the count and the bytes */
+    friend bool operator==(const Allocations& allocations, std::size_t budget)
+    {
+        return allocations.count == budget;
+    }
+
+    friend bool operator<=(const Allocations& allocations, std::size_t budget)
+    {
+        return allocations.count <= budget;
+    }
+
+    friend std::ostream& operator<<(std::ostream& out, const Allocations& allocations)
+    {
+        return out << allocations.count << " allocations of " << allocations.bytes << " bytes";
+    }
+};
+
+static thread_local Allocations* tracked_allocations = nullptr;
+
+static void* tracked_new(std::size_t size)
+{
+    if (tracked_allocations) {
+        ++tracked_allocations->count;
+        tracked_allocations->bytes += size;
+    }
+
+    if (auto ptr = std::malloc(size ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size)
+{
+    return tracked_new(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return tracked_new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+template <typename F>
+Allocations count_allocations(F f)
+{
+    Allocations result;
+    auto outer = tracked_allocations;
+    tracked_allocations = &result;
+    f();
+    tracked_allocations = outer;
+
+    return result;
+}
+
+/* The pseudo-random numbers and text of the randomized tests, the same
+ * on every platform for a given seed */
+struct Random {
+    unsigned seed;
+
+    /* A number in [0, bound) */
+    unsigned operator()(unsigned bound)
+    {
+        return ((seed = seed * 1103515245 + 12345) >> 16) % bound;
+    }
+
+    /* length characters drawn from alphabet */
+    std::string text(std::size_t length, std::string_view alphabet)
+    {
+        std::string result(length, '\0');
+        for (auto& c : result)
+            c = alphabet[(*this)(static_cast<unsigned>(alphabet.size()))];
+        return result;
+    }
+};
+
 TEST_CASE("Construct, compare and print strings")
 {
     std::string str1 { "String \t123!.," };
@@ -123,6 +234,95 @@ TEST_CASE("Appending, inserting and deleting characters")
         CHECK((s + py_str) == "sHello world");
     }
 
+    SUBCASE("Chains of + are built once")
+    {
+        String space(" "), bang("!");
+        auto expr = py_str + space + py_str + '!' + bang;
+        CHECK(expr.size() == 25);
+        CHECK(expr == "Hello world Hello world!!");
+        String joined = '<' + (py_str + space) + ('>' + py_str);
+        CHECK(joined == "<Hello world >Hello world");
+        CHECK(joined.str.capacity() < 2 * joined.size());
+
+        std::ostringstream out;
+        out << (py_str + '.');
+        CHECK(out.str() == "Hello world.");
+    }
+
+    SUBCASE("Expressions are taken wherever a string is")
+    {
+        String a("ab"), b("cd");
+        String abcd("abcd");
+        CHECK(abcd == a + b);
+        CHECK(!(abcd != a + b));
+        CHECK(a + b == b.copy().replace("cd", "ab") + b);
+        CHECK(StringView("xabcd").find(a + b) == 1);
+
+        String appended("<");
+        appended += a + b + '>';
+        CHECK(appended == "<abcd>");
+        appended += appended + a;
+        CHECK(appended == "<abcd><abcd>ab");
+
+        String inserted("[]");
+        inserted.insert(1, a + '-' + b);
+        CHECK(inserted == "[ab-cd]");
+        inserted.insert(0, inserted + '|');
+        CHECK(inserted == "[ab-cd]|[ab-cd]");
+
+        String replaced("x-x");
+        CHECK(replaced.replace("x", a + b) == "abcd-abcd");
+        auto length = [](StringView view) { return view.size(); };
+        CHECK(length(a + b) == 4);
+        CHECK(String(a + b) == "abcd");
+    }
+
+    SUBCASE("Temporaries are appended to in place")
+    {
+        String head("head");
+        head.str.reserve(64);
+        auto data = head.c_str();
+        String result = std::move(head) + py_str + '!';
+        CHECK(result == "headHello world!");
+        CHECK(result.c_str() == data);
+
+        String twice = String("ab") + (py_str + ' ');
+        CHECK(twice == "abHello world ");
+        String self("xy");
+        self = std::move(self) + (self + self);
+        CHECK(self == "xyxyxy");
+    }
+
+    SUBCASE("Temporaries on the right are never viewed")
+    {
+        auto make = [](const char* text) { return String(text); };
+        auto expr = py_str + make(", again");
+        auto chained = py_str + ' ' + make("!");
+        auto from_std = py_str + std::string(" std");
+        auto prefixed = '>' + make("quote");
+        String built = expr;
+        CHECK(built == "Hello world, again");
+        CHECK(chained == "Hello world !");
+        CHECK(from_std == "Hello world std");
+        CHECK(prefixed == ">quote");
+        CHECK(make("a") + make("b") == "ab");
+        CHECK(py_str + std::move(built) == "Hello worldHello world, again");
+    }
+
+    SUBCASE("Methods can be called on an expression")
+    {
+        String space(" ");
+        CHECK((py_str + '!').upper() == "HELLO WORLD!");
+        CHECK((py_str + space).strip().lower() == "hello world");
+        CHECK((py_str + space + py_str).replace("world", "there", 1) == "Hello there Hello world");
+        CHECK((py_str + space + py_str).count("o") == 4);
+        CHECK((py_str + space + py_str).find("world") == 6);
+        CHECK((py_str + '!').endswith("d!"));
+        CHECK((py_str + space + py_str).split() == std::vector<String> { "Hello", "world", "Hello", "world" });
+        CHECK((py_str + '.').len() == 12);
+        CHECK(String(py_str + space).c_str() == std::string("Hello world "));
+    }
+
     SUBCASE("Insert char at str_index")
     {
         CHECK(py_str.insert(5, ',') == "Hello, world");
@@ -265,6 +465,28 @@ TEST_CASE("Replace phrase with another one")
     CHECK(String("I like bananas, do you like bananas?").replace("bananas", "apples") == "I like apples, do you like apples?");
     CHECK(String("work hard, play hard, die hard").replace("hard", "easier") == "work easier, play easier, die easier");
     CHECK(String("work hard, play hard, die hard").replace("hard", "") == "work , play , die ");
+
+    SUBCASE("Limit the number of replacements")
+    {
+        CHECK(String("one one one").replace("one", "two", 2) == "two two one");
+        CHECK(String("one one one").replace("one", "three", 1) == "three one one");
+        CHECK(String("one one one").replace("one", "two", 0) == "one one one");
+        CHECK(String("aaaa").replace("aa", "b") == "bb");
+    }
+
+    SUBCASE("Empty old value inserts between characters")
+    {
+        CHECK(String("abc").replace("", "-") == "-a-b-c-");
+        CHECK(String("abc").replace("", "-", 2) == "-a-bc");
+        CHECK(String().replace("", "x") == "x");
+    }
+
+    SUBCASE("Replacement taken from the string itself")
+    {
+        String py_str { "abcabc" };
+        py_str.replace("a", StringView(py_str).slice(2, 2));
+        CHECK(py_str == "cbccbc");
+    }
 }
 
 TEST_CASE("Find last position of value in string")
@@ -339,6 +561,30 @@ TEST_CASE("Strip characters from both sides")
     CHECK(String("####!!-!!!").strip("!- #") == "");
 }
 
+TEST_CASE("Strip into views")
+{
+    String padded { "  \t  Hello world  \n" };
+    const auto original = padded.copy();
+
+    CHECK(padded.lstripped() == "\t  Hello world  \n");
+    CHECK(padded.lstripped(" \t") == "Hello world  \n");
+    CHECK(padded.rstripped("\n ") == "  \t  Hello world");
+    CHECK(padded.stripped(" \t\n") == "Hello world");
+    CHECK(padded.stripped(" \t\n").data() == padded.c_str() + 5);
+    CHECK(padded == original);
+
+    CHECK(StringView("####!!-!!!").stripped("!- #").empty());
+    CHECK(StringView("####!!-!!!").lstripped("!- #").empty());
+    CHECK(StringView("####!!-!!!").rstripped("!- #").empty());
+    CHECK(StringView().stripped().empty());
+    CHECK(StringView("Hello").stripped('#') == "Hello");
+
+    std::string large(1 << 20, 'x');
+    large.replace(0, 3, "   ");
+    CHECK(StringView(large).lstripped().size() == large.size() - 3);
+    CHECK(StringView(large).lstripped().data() == large.data() + 3);
+}
+
 TEST_CASE("Check if string contains a phrase")
 {
     CHECK(String("one two three four five").contains("six") == false);
@@ -358,7 +604,36 @@ TEST_CASE("Join Strings")
     CHECK(String("#").join(strings) == "hello#world#!");
     CHECK(String(" ").join(strings2) == "hello world");
     CHECK(String("#").join("hello") == "h#e#l#l#o");
-    CHECK(String("#").join(strings3) == "h#e#l#l#o");
+    CHECK(String("#").join(strings3) == "hello");
+
+    SUBCASE("Any range of string-likes")
+    {
+        std::vector<StringView> views { "a", "b", "c" };
+        std::vector<std::string> std_strings { "hello", "world" };
+        const char* c_strings[] = { "x", "y" };
+        std::vector<String> none;
+        CHECK(String(", ").join(views) == "a, b, c");
+        CHECK(String("").join(std_strings) == "helloworld");
+        CHECK(String("-").join(c_strings) == "x-y");
+        CHECK(String("-").join(std::vector<std::string> { "only" }) == "only");
+        CHECK(String("-").join(std::vector<String> { "only" }) == "only");
+        CHECK(String("-").join(std::vector<StringView> { "only" }) == "only");
+        CHECK(String("-").join(none) == "");
+        CHECK(String("+").join(StringView("1 2  3").split_view()) == "1+2+3");
+    }
+
+    SUBCASE("Join on several threads")
+    {
+        std::vector<std::string> pieces;
+        for (int i = 0; i < 100000; ++i)
+            pieces.push_back(std::to_string(i));
+
+        auto expected = String(",").join(pieces);
+        CHECK(String(",").join(pieces, Parallel { 4 }) == expected);
+        CHECK(String(",").join(pieces, Parallel { 3 }) == expected);
+        CHECK(String(",").join(std::vector<std::string> { "a", "b" }, Parallel {}) == "a,b");
+        CHECK(String(",").join(std::vector<String> { "only" }, Parallel { 4 }) == "only");
+    }
 }
 
 TEST_CASE("Split String into a vector")
@@ -374,6 +649,80 @@ TEST_CASE("Split String into a vector")
         CHECK(String("welcome to the jungle!").split() == result);
         CHECK(String("welcome     to the    jungle!").split() == result);
     }
+
+    SUBCASE("Explicit separator keeps empty parts")
+    {
+        using tokens = std::vector<String>;
+        CHECK(String("a,b,,c").split(",") == tokens { "a", "b", "", "c" });
+        CHECK(String("a,b,,c").split(",", 2) == tokens { "a", "b", ",c" });
+        CHECK(String("key=>value=>").split("=>") == tokens { "key", "value", "" });
+        CHECK(String().split(",") == tokens { "" });
+        CHECK_THROWS_AS(String("abc").split(""), std::invalid_argument);
+    }
+
+    SUBCASE("Split from the right")
+    {
+        using tokens = std::vector<String>;
+        CHECK(String("  a b c ").rsplit() == tokens { "a", "b", "c" });
+        CHECK(String("  a b c ").rsplit(1) == tokens { "  a b", "c" });
+        CHECK(String("  a b c ").rsplit(0) == tokens { "  a b c" });
+        CHECK(String(" \t ").rsplit().empty());
+        CHECK(String("a,b,,c").rsplit(",") == tokens { "a", "b", "", "c" });
+        CHECK(String("a,b,,c").rsplit(",", 2) == tokens { "a,b", "", "c" });
+        CHECK(String("aaa").rsplit("aa") == tokens { "a", "" });
+        CHECK(String("aaa").split("aa") == tokens { "", "a" });
+        CHECK(String().rsplit(",") == tokens { "" });
+        CHECK_THROWS_AS(String("abc").rsplit(""), std::invalid_argument);
+    }
+
+    SUBCASE("Split into an existing container")
+    {
+        std::vector<StringView> views { "stale" };
+        String path { "/usr/local/share/doc/py_string/README.md" };
+        CHECK(path.split_to(views, "/").size() == 7);
+        CHECK(views.front().empty());
+        CHECK(views.back() == "README.md");
+        CHECK(views[1].data() == path.c_str() + 1);
+
+        std::vector<std::string> strings;
+        path.rsplit_to(strings, "/", 1);
+        CHECK(strings == std::vector<std::string> { "/usr/local/share/doc/py_string", "README.md" });
+        CHECK(StringView("one two  three").split_to(strings, 1) == std::vector<std::string> { "one", "two  three" });
+        CHECK(StringView("one two  three").rsplit_to(strings, 1) == std::vector<std::string> { "one two", "three" });
+    }
+
+    SUBCASE("Long inputs agree with the reference in both directions")
+    {
+        std::string input;
+        for (int i = 0; i < 300; ++i)
+            input += i % 7 == 0 ? " \t" : i % 5 == 0 ? "::" : i % 3 == 0 ? ":" : "word";
+
+        auto reference = [](const std::string& string, const std::string& sep) {
+            std::vector<std::string> parts;
+            std::size_t start = 0;
+            for (auto found = string.find(sep); found != std::string::npos; found = string.find(sep, start)) {
+                parts.push_back(string.substr(start, found - start));
+                start = found + sep.size();
+            }
+            parts.push_back(string.substr(start));
+            return parts;
+        };
+
+        std::vector<std::string> forward, backward;
+        for (std::string sep : { ":", "::", " \t", "word", "d:" }) {
+            StringView(input).split_to(forward, sep);
+            StringView(input).rsplit_to(backward, sep);
+            CHECK(forward == reference(input, sep));
+            if (sep != "::")
+                CHECK(backward == forward);
+        }
+
+        StringView(input).split_to(forward);
+        StringView(input).rsplit_to(backward);
+        CHECK(forward == backward);
+        CHECK(StringView(input).rsplit_to(backward, 5).size() == 6);
+        CHECK(StringView(backward.back()) == StringView(forward.back()));
+    }
 }
 
 TEST_CASE("Split lines")
@@ -387,4 +736,1219 @@ TEST_CASE("Split lines")
     CHECK(string.splitlines() == wo_newlines);
     CHECK(string.splitlines(true) == w_newlines);
     CHECK(string1.splitlines() == wo_newlines1);
-}
\ No newline at end of file
+    CHECK(String("no line break").splitlines(true) == std::vector<String> { "no line break" });
+    CHECK(String().splitlines().empty());
+    CHECK(String("one\r\ntwo\rthree\x1c").splitlines() == std::vector<String> { "one", "two", "three" });
+}
+
+TEST_CASE("String views")
+{
+    String py_str { "Hello world" };
+    std::string std_str { "Hello world" };
+
+    SUBCASE("Construct from string-likes")
+    {
+        CHECK(StringView(py_str) == "Hello world");
+        CHECK(StringView(std_str) == "Hello world");
+        CHECK(StringView(std::string_view("Hello")) == "Hello");
+        CHECK(StringView("Hello").size() == 5);
+        CHECK(StringView().empty());
+        CHECK(StringView(py_str).data() == py_str.c_str());
+    }
+
+    SUBCASE("Indexing and slicing")
+    {
+        StringView view { py_str };
+        CHECK(view[0] == 'H');
+        CHECK(view[-1] == 'd');
+        CHECK(view.slice(0, 4) == "Hello");
+        CHECK(view.slice(3, 5) == "lo ");
+        CHECK(view(-2, -1) == "ld");
+        CHECK(view.slice(3, 2) == "");
+        CHECK(view.slice(6, 100) == "world");
+    }
+
+    SUBCASE("Read-only queries")
+    {
+        StringView view { "I like apples, my favourite food is apples" };
+        CHECK(view.find("apples") == 7);
+        CHECK(view.rfind("apples") == 36);
+        CHECK(view.find("pears") == Not_found);
+        CHECK(view.count("apples") == 2);
+        CHECK(view.count("apples", 8) == 1);
+        CHECK(view.count("") == view.size() + 1);
+        CHECK(view.contains("food"));
+        CHECK(!view.contains(""));
+        CHECK(view.startswith("I like"));
+        CHECK(!view.startswith("apples"));
+        CHECK(view.endswith(std::string("apples")));
+        CHECK(!StringView("es").endswith("apples"));
+    }
+
+    SUBCASE("Character classes")
+    {
+        CHECK(StringView("hello").isalpha());
+        CHECK(StringView("123").isdigit());
+        CHECK(StringView("abc123").isalnum());
+        CHECK(StringView("hello world!").islower());
+        CHECK(StringView("HELLO123.").isupper());
+        CHECK(StringView(" \t\n").isspace());
+        CHECK(!StringView().isalpha());
+    }
+}
+
+TEST_CASE("Split lazily into views")
+{
+    auto collect = [](SplitView range) {
+        std::vector<std::string> tokens;
+        for (auto token : range)
+            tokens.emplace_back(token);
+        return tokens;
+    };
+
+    SUBCASE("Default separator is any whitespace")
+    {
+        using tokens = std::vector<std::string>;
+        CHECK(collect(StringView("  welcome \t to\nthe  jungle! ").split_view()) == tokens { "welcome", "to", "the", "jungle!" });
+        CHECK(collect(StringView("a b  c  ").split_view(1)) == tokens { "a", "b  c  " });
+        CHECK(collect(StringView("  a b  ").split_view(0)) == tokens { "a b  " });
+        CHECK(collect(StringView("   ").split_view()).empty());
+        CHECK(collect(StringView().split_view()).empty());
+    }
+
+    SUBCASE("Explicit separator")
+    {
+        using tokens = std::vector<std::string>;
+        CHECK(collect(StringView("a,b,,c").split_view(",")) == tokens { "a", "b", "", "c" });
+        CHECK(collect(StringView("a,,b").split_view(",", 1)) == tokens { "a", ",b" });
+        CHECK(collect(StringView("key=>value=>").split_view("=>")) == tokens { "key", "value", "" });
+        CHECK(collect(StringView("").split_view(",")) == tokens { "" });
+        CHECK(collect(StringView().split_view(",")) == tokens { "" });
+        CHECK(collect(StringView().split_view(",", 0)) == tokens { "" });
+        CHECK_THROWS_AS(StringView("abc").split_view(""), std::invalid_argument);
+    }
+
+    SUBCASE("Tokens point into the original buffer")
+    {
+        String py_str { "hello world" };
+        auto it = py_str.split_view().begin();
+        CHECK(it->data() == py_str.c_str());
+        CHECK(std::next(it)->data() == py_str.c_str() + 6);
+        CHECK(std::distance(py_str.split_view().begin(), py_str.split_view().end()) == 2);
+    }
+}
+
+TEST_CASE("Whitespace tokenizer matches a byte-wise reference")
+{
+    auto reference = [](const std::string& input) {
+        std::vector<std::string> tokens;
+        std::string token;
+        for (unsigned char c : input) {
+            if (c == ' ' || (c >= '\t' && c <= '\r')) {
+                if (!token.empty())
+                    tokens.push_back(token);
+                token.clear();
+            } else {
+                token += static_cast<char>(c);
+            }
+        }
+        if (!token.empty())
+            tokens.push_back(token);
+        return tokens;
+    };
+
+    const char alphabet[] = { 'a', 'Z', '0', ' ', '\t', '\n', '\v', '\f', '\r', '\x08', '\x0e', '\x1f', '!', '\x80', '\xa0', '\xff' };
+    Random random { 12345 };
+    for (int round = 0; round < 200; ++round) {
+        auto input = random.text(random(150), std::string_view(alphabet, sizeof(alphabet)));
+
+        std::vector<std::string> tokens;
+        for (auto token : StringView(input).split_view())
+            tokens.emplace_back(token);
+
+        REQUIRE(tokens == reference(input));
+    }
+}
+
+TEST_CASE("Case mapping only touches ASCII letters")
+{
+    std::string input;
+    for (int c = 0; c < 256; ++c)
+        input += static_cast<char>(c);
+    input += input + input;
+
+    std::string upper, lower, swapped;
+    for (unsigned char c : input) {
+        upper += static_cast<char>(c >= 'a' && c <= 'z' ? c - 32 : c);
+        lower += static_cast<char>(c >= 'A' && c <= 'Z' ? c + 32 : c);
+        swapped += static_cast<char>(c >= 'a' && c <= 'z' ? c - 32 : c >= 'A' && c <= 'Z' ? c + 32 : c);
+    }
+
+    for (std::size_t length = 0; length < input.size(); length += 7) {
+        auto part = input.substr(input.size() - length);
+        auto expected = [&](const std::string& mapped) { return mapped.substr(mapped.size() - length); };
+        CHECK(String(part).upper() == expected(upper));
+        CHECK(String(part).lower() == expected(lower));
+        CHECK(String(part).casefold() == expected(lower));
+        CHECK(String(part).swapcase() == expected(swapped));
+    }
+
+    CHECK(String("żółw ÉCOLE").lower() == "żółw École");
+    CHECK(String("x").capitalize() == "X");
+}
+
+TEST_CASE("Classify all character classes in one pass")
+{
+    CHECK(String().classify() == 0);
+    CHECK(String("hello").classify() == (Char_class::Alpha | Char_class::Alnum | Char_class::Lower));
+    CHECK(String("HELLO123.").classify() == Char_class::Upper);
+    CHECK(String("123455").classify() == (Char_class::Digit | Char_class::Alnum));
+    CHECK(String(" \t\n").classify() == Char_class::Space);
+    CHECK(String("123455aZd").classify() == Char_class::Alnum);
+    CHECK(String("hello\x01").islower());
+    CHECK(!String("\xc3\xa9t\xc3\xa9").isalpha());
+
+    auto reference = [](const std::string& input) {
+        bool alpha = !input.empty(), digit = alpha, alnum = alpha, space = alpha, lower = false, upper = false;
+        for (unsigned char c : input) {
+            bool is_lower = c >= 'a' && c <= 'z', is_upper = c >= 'A' && c <= 'Z', is_digit = c >= '0' && c <= '9';
+            alpha &= is_lower || is_upper;
+            digit &= is_digit;
+            alnum &= is_lower || is_upper || is_digit;
+            space &= c == ' ' || (c >= '\t' && c <= '\r');
+            lower |= is_lower;
+            upper |= is_upper;
+        }
+        return (alpha ? Char_class::Alpha : 0u) | (digit ? Char_class::Digit : 0u) | (alnum ? Char_class::Alnum : 0u)
+            | (space ? Char_class::Space : 0u) | (lower && !upper ? Char_class::Lower : 0u) | (upper && !lower ? Char_class::Upper : 0u);
+    };
+
+    const std::string alphabets[] = { "abcxyz", "ABCXYZ", "0123456789", " \t\r\n", "aZ09", "az!@[`{", std::string("a\0\x80\xff", 4) };
+    Random random { 42 };
+    for (int round = 0; round < 500; ++round) {
+        auto input = random.text(random(100), alphabets[round % 7]);
+
+        StringView view { input };
+        auto flags = reference(input);
+        REQUIRE(view.classify() == flags);
+        REQUIRE(view.isalpha() == ((flags & Char_class::Alpha) != 0));
+        REQUIRE(view.isdigit() == ((flags & Char_class::Digit) != 0));
+        REQUIRE(view.isalnum() == ((flags & Char_class::Alnum) != 0));
+        REQUIRE(view.isspace() == ((flags & Char_class::Space) != 0));
+        REQUIRE(view.islower() == ((flags & Char_class::Lower) != 0));
+        REQUIRE(view.isupper() == ((flags & Char_class::Upper) != 0));
+    }
+}
+
+TEST_CASE("Replace many patterns in one pass")
+{
+    Replacer replacer { { "he", "HE" }, { "hers", "HERS" }, { "she", "SHE" }, { "his", "HIS" } };
+
+    SUBCASE("Leftmost match wins, then the longest one")
+    {
+        CHECK(replacer.replaced("ushers") == "uSHErs");
+        CHECK(replacer.replaced("hershe") == "HERSHE");
+        CHECK(replacer.replaced("hisher") == "HISHEr");
+        CHECK(replacer.replaced("nothing here") == "nothing HEre");
+        CHECK(replacer.replaced("") == "");
+    }
+
+    SUBCASE("Replace in place")
+    {
+        String py_str { "she sells his shells" };
+        CHECK(replacer.replace(py_str) == "SHE sells HIS SHElls");
+        String unchanged { "xyz" };
+        CHECK(replacer.replace(unchanged) == "xyz");
+    }
+
+    SUBCASE("Replacements are not rescanned")
+    {
+        Replacer swap { { "a", "b" }, { "b", "a" }, { "abc", "" } };
+        CHECK(swap.replaced("aabbabcab") == "bbaaba");
+    }
+
+    SUBCASE("Same result as chained single replacements for disjoint patterns")
+    {
+        std::vector<std::pair<std::string, std::string>> pairs { { "&", "&amp;" }, { "<", "&lt;" }, { ">", "&gt;" }, { "\"", "&quot;" } };
+        Replacer escape { pairs };
+        String chained { "<a href=\"x\">&</a>" };
+        for (const auto& pair : pairs)
+            chained.replace(pair.first, pair.second);
+        CHECK(escape.replaced("<a href=\"x\">&</a>") == chained);
+    }
+
+    SUBCASE("Matches a brute force leftmost-longest reference")
+    {
+        Random random { 7 };
+        auto random_string = [&random](unsigned max_length) { return random.text(1 + random(max_length), "abc"); };
+
+        for (int round = 0; round < 200; ++round) {
+            std::vector<std::pair<std::string, std::string>> pairs;
+            for (unsigned i = 0, n = 1 + random(5); i < n; ++i)
+                pairs.emplace_back(random_string(4), std::to_string(i));
+
+            auto text = random_string(40);
+            std::string expected;
+            for (std::size_t pos = 0; pos < text.size();) {
+                const std::pair<std::string, std::string>* best = nullptr;
+                for (const auto& pair : pairs)
+                    if (text.compare(pos, pair.first.size(), pair.first) == 0 && (!best || pair.first.size() > best->first.size()))
+                        best = &pair;
+                if (best) {
+                    expected += best->second;
+                    pos += best->first.size();
+                } else {
+                    expected += text[pos++];
+                }
+            }
+
+            REQUIRE(Replacer(pairs).replaced(text) == expected);
+        }
+    }
+
+    CHECK_THROWS_AS(Replacer({ { "", "x" } }), std::invalid_argument);
+}
+
+TEST_CASE("Translate characters through a table")
+{
+    CHECK(String("hello world").translate(String::maketrans("lo", "01")) == "he001 w1r0d");
+    CHECK(String("hello world").translate(String::maketrans("", "", "lo ")) == "hewrd");
+    CHECK(String("hello world").translate(String::maketrans("ho", "HO", "l")) == "HeO wOrd");
+    CHECK(String().translate(String::maketrans("a", "b")) == "");
+    CHECK_THROWS_AS(String::maketrans("ab", "c"), std::invalid_argument);
+
+    SUBCASE("Matches a byte-wise reference over all bytes")
+    {
+        std::string from, to, deletechars;
+        for (int c = 0; c < 256; c += 3) {
+            from += static_cast<char>(c);
+            to += static_cast<char>(255 - c);
+        }
+        for (int c = 1; c < 256; c += 7)
+            deletechars += static_cast<char>(c);
+        auto table = String::maketrans(from, to, deletechars);
+
+        std::string input;
+        for (int i = 0; i < 1000; ++i)
+            input += static_cast<char>((i * 131) & 0xff);
+
+        std::string expected;
+        for (unsigned char c : input) {
+            if (deletechars.find(static_cast<char>(c)) != std::string::npos)
+                continue;
+            auto pos = from.find(static_cast<char>(c));
+            expected += pos == std::string::npos ? static_cast<char>(c) : to[pos];
+        }
+
+        CHECK(String(input).translate(table) == expected);
+    }
+}
+
+TEST_CASE("Strings with custom allocators")
+{
+    SUBCASE("Arena strings")
+    {
+        Arena arena(256);
+        ArenaAllocator<char> alloc { arena };
+        ArenaString py_str { "Hello wonderful world, how are you?", alloc };
+
+        auto words = py_str.split();
+        REQUIRE(words.size() == 6);
+        CHECK(words[1] == "wonderful");
+        CHECK(words.get_allocator().arena == &arena);
+        CHECK(words[1].get_allocator() == alloc);
+        CHECK(py_str.slice(0, 4).get_allocator() == alloc);
+        CHECK(py_str.copy().upper() == "HELLO WONDERFUL WORLD, HOW ARE YOU?");
+        CHECK((py_str + '!').get_allocator() == alloc);
+        CHECK(py_str.replace("o", "0") == "Hell0 w0nderful w0rld, h0w are y0u?");
+        CHECK(String("-").join(words) == "Hello-wonderful-world,-how-are-you?");
+
+        auto capacity = arena.capacity();
+        CHECK(capacity >= 256);
+        arena.reset();
+        ArenaString reused { "short", alloc };
+        CHECK(reused == "short");
+        CHECK(arena.capacity() == capacity);
+    }
+
+    SUBCASE("Polymorphic allocators")
+    {
+        Arena arena;
+        pmr::String py_str { "one two three", &arena };
+        auto words = py_str.split();
+        CHECK(words.size() == 3);
+        CHECK(words[2].get_allocator().resource() == &arena);
+        CHECK(words[2] == "three");
+        auto copy = py_str.copy();
+        CHECK(copy.get_allocator().resource() == &arena);
+        CHECK(copy == "one two three");
+    }
+}
+
+TEST_CASE("Intern strings")
+{
+    InternTable table;
+
+    SUBCASE("Equal strings get equal ids")
+    {
+        auto cpu = table.intern("cpu");
+        auto mem = table.intern(std::string("mem"));
+        CHECK(cpu != mem);
+        CHECK(table.intern(String("cpu")) == cpu);
+        CHECK(table.find("mem") == mem);
+        CHECK(table.find("disk") == InternTable::Not_interned);
+        CHECK(table.view(cpu) == "cpu");
+        CHECK(table.size() == 2);
+    }
+
+    SUBCASE("Split into interned ids")
+    {
+        auto ids = String("cpu mem cpu  disk mem").split(table);
+        REQUIRE(ids.size() == 5);
+        CHECK(ids[0] == ids[2]);
+        CHECK(ids[1] == ids[4]);
+        CHECK(table.view(ids[3]) == "disk");
+        auto letters = StringView("a,b,a").split(table, ",");
+        CHECK(letters == std::vector<InternTable::id_type> { table.find("a"), table.find("b"), table.find("a") });
+        CHECK(table.size() == 5);
+    }
+
+    SUBCASE("Short strings after a long one in the same shard")
+    {
+        InternTable single_shard(0);
+        std::string long_string(20000, 'x');
+        auto big = single_shard.intern(long_string);
+        auto small = single_shard.intern("y");
+        CHECK(single_shard.view(big) == long_string);
+        CHECK(single_shard.view(small) == "y");
+        CHECK(single_shard.intern("z") != small);
+    }
+
+    SUBCASE("Probes stay short in large tables")
+    {
+        for (int i = 0; i < 50000; ++i)
+            table.intern("key" + std::to_string(i));
+        CHECK(table.size() == 50000);
+        CHECK(table.max_probe_length() <= 64);
+        CHECK(table.find("key49999") == table.intern("key49999"));
+    }
+
+    SUBCASE("Intern from several threads")
+    {
+        std::vector<std::thread> threads;
+        std::vector<std::vector<InternTable::id_type>> ids(4);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&table, &ids, t] {
+                for (int i = 0; i < 20000; ++i)
+                    ids[t].push_back(table.intern(std::to_string((i * 7 + t) % 5000)));
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        CHECK(table.size() == 5000);
+        for (int t = 0; t < 4; ++t)
+            for (int i = 0; i < 20000; i += 97)
+                REQUIRE(table.view(ids[t][i]) == std::to_string((i * 7 + t) % 5000));
+    }
+}
+
+TEST_CASE("Rope")
+{
+    SUBCASE("Edits")
+    {
+        Rope rope("Hello World");
+        CHECK(rope.len() == 11);
+        CHECK(rope[4] == 'o');
+        CHECK(rope[-1] == 'd');
+        rope.insert(5, ",");
+        rope += '!';
+        CHECK(rope == "Hello, World!");
+        rope.del(5);
+        rope.del(-1, -1);
+        CHECK(rope == "Hello World");
+        CHECK(rope.slice(6, 10) == "World");
+        CHECK(rope(0, 100) == "Hello World");
+        CHECK(rope.startswith("Hello"));
+        CHECK(rope.endswith("World"));
+        CHECK(!rope.endswith("Hello"));
+        CHECK(rope.flatten() == "Hello World");
+
+        Rope copy = rope;
+        copy.insert(0, copy);
+        CHECK(copy == "Hello WorldHello World");
+        CHECK(rope == "Hello World");
+    }
+
+    SUBCASE("Long text is shared between chunks")
+    {
+        std::string text(5000, 'x');
+        text[4321] = 'y';
+        Rope rope(text);
+        CHECK(rope[4321] == 'y');
+        int chunks = 0;
+        rope.for_each_chunk([&chunks](StringView chunk) {
+            CHECK(chunk.size() <= Rope::Chunk_size);
+            ++chunks;
+        });
+        CHECK(chunks == 5);
+        CHECK(rope.slice(4000, 4999) == StringView(text.data() + 4000, 1000));
+    }
+
+    SUBCASE("Random edits match std::string")
+    {
+        Random random { 99 };
+        std::string reference;
+        Rope rope;
+        for (int i = 0; i < 3000; ++i) {
+            auto pos = random(static_cast<unsigned>(reference.size()) + 1);
+            if (random(3) || reference.empty()) {
+                std::string piece(1 + random(i % 10 ? 8 : 3000), static_cast<char>('a' + random(26)));
+                reference.insert(pos, piece);
+                rope.insert(static_cast<int>(pos), StringView(piece.data(), piece.size()));
+            } else {
+                pos = std::min<unsigned>(pos, static_cast<unsigned>(reference.size()) - 1);
+                auto count = 1 + random(static_cast<unsigned>(reference.size() - pos));
+                reference.erase(pos, count);
+                rope.del(static_cast<int>(pos), static_cast<int>(pos + count - 1));
+            }
+            REQUIRE(rope.size() == reference.size());
+            if (!reference.empty()) {
+                auto index = random(static_cast<unsigned>(reference.size()));
+                REQUIRE(rope[static_cast<int>(index)] == reference[index]);
+            }
+        }
+        CHECK(rope == StringView(reference.data(), reference.size()));
+    }
+
+    SUBCASE("Cutting the same chunk many times keeps the tree balanced")
+    {
+        Rope rope(String(std::string(4096, 'x')));
+        for (int i = 1; i < 1500; ++i)
+            rope.del(i);
+        CHECK(rope.size() == 4096 - 1499);
+        CHECK(rope.height() < 64);
+        CHECK(rope.count("x") == 4096 - 1499);
+    }
+
+    SUBCASE("Search across chunk boundaries")
+    {
+        Rope rope("Hello World");
+        CHECK(rope.find("o") == 4);
+        CHECK(rope.rfind("o") == 7);
+        CHECK(rope.index("World") == 6);
+        CHECK(rope.rindex("l") == 9);
+        CHECK(rope.count("l") == 3);
+        CHECK(rope.contains("lo W"));
+        CHECK(!rope.contains("world"));
+        CHECK(!rope.contains(""));
+        CHECK(rope.contains("") == String("Hello World").contains(""));
+        CHECK(rope.find("") == 0);
+        CHECK(rope.rfind("") == 11);
+        CHECK(rope.count("") == 12);
+        CHECK(Rope().find("a") == Not_found);
+
+        /* Appending views keeps every piece in its own chunk, some of
+         * them shorter than the needles */
+        Random random { 7 };
+        std::string reference;
+        Rope pieces;
+        for (int i = 0; i < 400; ++i) {
+            auto piece = random.text(1 + random(i % 3 ? 4 : 40), "abc");
+            reference += piece;
+            pieces += StringView(piece.data(), piece.size());
+        }
+
+        for (std::string value : { "a", "ab", "abc", "aaa", "cabca", "bbbbbb", "abcabcabcabc" }) {
+            StringView view(value.data(), value.size());
+            CHECK(pieces.find(view) == reference.find(value));
+            CHECK(pieces.rfind(view) == reference.rfind(value));
+            CHECK(pieces.count(view) == StringView(reference).count(view));
+        }
+    }
+}
+
+TEST_CASE("Format")
+{
+    SUBCASE("Fields")
+    {
+        CHECK(py_str::format("{}: {:>8} {:.3f}", "cpu", 42, 3.14159) == "cpu:       42 3.142");
+        CHECK(py_str::format("{1}{0}{1}", 'a', String("b")) == "bab");
+        CHECK(py_str::format("{{}} {}", std::string("x")) == "{} x");
+        CHECK(py_str::format("no fields") == "no fields");
+        CHECK(py_str::format("{} {}", true, false) == "True False");
+    }
+
+    SUBCASE("Alignment and fill")
+    {
+        CHECK(py_str::format("[{:<6}]", "ab") == "[ab    ]");
+        CHECK(py_str::format("[{:^6}]", "ab") == "[  ab  ]");
+        CHECK(py_str::format("[{:*>6}]", "ab") == "[****ab]");
+        CHECK(py_str::format("[{:6}]", 12) == "[    12]");
+        CHECK(py_str::format("[{:=+6}]", 12) == "[+   12]");
+        CHECK(py_str::format("[{:06}]", -12) == "[-00012]");
+        CHECK(py_str::format("[{:.2}]", "abc") == "[ab]");
+    }
+
+    SUBCASE("Integers")
+    {
+        CHECK(py_str::format("{:b} {:o} {:x} {:X}", 5, 8, 255, 255) == "101 10 ff FF");
+        CHECK(py_str::format("{:#b} {:#o} {:#x} {:#X}", 5, 8, 255, 255) == "0b101 0o10 0xff 0XFF");
+        CHECK(py_str::format("{:,} {:_x}", -1234567, 0xdeadbeefu) == "-1,234,567 dead_beef");
+        CHECK(py_str::format("{:#012_b}", 10) == "0b0000001010");
+        CHECK(py_str::format("{:c}{:c}", 65, 0x20ac) == "A\xe2\x82\xac");
+        CHECK(py_str::format("{} {}", std::numeric_limits<long long>::min(), std::numeric_limits<unsigned long long>::max())
+            == "-9223372036854775808 18446744073709551615");
+        CHECK(py_str::format("{: d} {:+d}", 1, 1) == " 1 +1");
+    }
+
+    SUBCASE("Floats")
+    {
+        CHECK(py_str::format("{} {} {} {}", 1.0, 0.1, 1e16, 1e-5) == "1.0 0.1 1e+16 1e-05");
+        CHECK(py_str::format("{:.2e} {:.3E}", 12345.678, 0.5) == "1.23e+04 5.000E-01");
+        CHECK(py_str::format("{:g} {:.3g} {:G}", 0.0001, 1234.5, 1e-10) == "0.0001 1.23e+03 1E-10");
+        CHECK(py_str::format("{:.1%}", 0.256) == "25.6%");
+        CHECK(py_str::format("{:,.2f}", 1234567.891) == "1,234,567.89");
+        CHECK(py_str::format("{:f} {:F} {}", -INFINITY, INFINITY, NAN) == "-inf INF nan");
+        CHECK(py_str::format("{:08.2f}", -3.14159) == "-0003.14");
+        CHECK(py_str::format("{:.0f}", 1e300).size() == 301);
+    }
+
+    SUBCASE("Format into an existing string")
+    {
+        String line("log: ");
+        py_str::format_to(line, "{}={:.1f}", "load", 0.25f);
+        CHECK(line == "log: load=0.2");
+    }
+
+    SUBCASE("Format string literals")
+    {
+        CHECK(py_str::format(PY_STRING_FORMAT("{}: {:>8} {:.3f}"), "cpu", 42, 3.14159) == "cpu:       42 3.142");
+        CHECK(py_str::format(PY_STRING_FORMAT("{{}} {1}{0}"), 'a', String("b")) == "{} ba");
+        String line("log: ");
+        py_str::format_to(line, PY_STRING_FORMAT("{}={:.1f}"), "load", 0.25f);
+        CHECK(line == "log: load=0.2");
+    }
+
+    SUBCASE("More fields than are recorded")
+    {
+        CHECK(py_str::format("{}-{}-{}-{}-{}-{}-{}-{}-{}-{}", 0, 1, 2, 3, 4, 5, 6, 7, 8, 9) == "0-1-2-3-4-5-6-7-8-9");
+        CHECK(py_str::format(PY_STRING_FORMAT("{}-{}-{}-{}-{}-{}-{}-{}-{}-{}"), 0, 1, 2, 3, 4, 5, 6, 7, 8, 9) == "0-1-2-3-4-5-6-7-8-9");
+    }
+
+    SUBCASE("Invalid format strings")
+    {
+        constexpr py_str::Format_string<int, double> fmt("{:>5d} {:.3f}");
+        CHECK(fmt.get() == "{:>5d} {:.3f}");
+        static_assert(fmt.fields().complete && fmt.fields().size == 3);
+#if !defined(__cpp_consteval)
+        CHECK_THROWS_AS(py_str::format("{", 1), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("}", 1), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{} {}", 1), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{0} {}", 1, 2), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{:d}", "text"), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{:.2d}", 1), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{:,x}", 1), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{:dx}", 5), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{:ff}", 1.5), std::invalid_argument);
+        CHECK_THROWS_AS(py_str::format("{!r}", 1), std::invalid_argument);
+#endif
+        CHECK_THROWS_AS(py_str::format("{:c}", -1), std::out_of_range);
+    }
+}
+
+TEST_CASE("Fixed strings")
+{
+    SUBCASE("Compile time")
+    {
+        constexpr auto header = FixedString<32>("  Content-Type ").strip().lower();
+        static_assert(header == "content-type");
+        static_assert(FixedString("select *").upper() == "SELECT *");
+        static_assert(FixedString<8>("a-b-c").replace("-", "::") == "a::b::c");
+        static_assert(FixedString<8>("xxxx").replace("x", "y", 2) == "yyxx");
+        static_assert(FixedString<8>("abc").replace("", "-") == "-a-b-c-");
+        static_assert(FixedString<8>("abc").replace("", "-", 2) == "-a-bc");
+        static_assert(FixedString<8>("").replace("", "-") == "-");
+        static_assert(FixedString("key=value").find("=") == 3);
+        static_assert(FixedString("key=value").startswith("key"));
+        static_assert(decltype(FixedString("abc"))::capacity() == 3);
+
+        constexpr auto parts = FixedString("a,b,,c").split(",");
+        static_assert(parts.size() == 4 && parts[2].empty() && parts[3] == "c");
+        static_assert(FixedString(", ").join<16>(parts) == "a, b, , c");
+        static_assert(FixedString("  one two\tthree ").split<4>(1)[1] == "two\tthree ");
+        static_assert(FixedString<32>("a b  c  ").split(1)[1] == "b  c  ");
+        static_assert(FixedString<32>("a b  c  ").split(1).size() == 2);
+    }
+
+    SUBCASE("Run time")
+    {
+        FixedString<16> name("  Mixed ");
+        name.strip().upper() += '!';
+        CHECK(name == "MIXED!");
+        CHECK(std::strlen(name.c_str()) == name.size());
+        CHECK(name.split().size() == 1);
+        CHECK_THROWS_AS(name += "too long for it", std::length_error);
+        CHECK_THROWS_AS(FixedString("a,b,c").split<2>(","), std::length_error);
+        CHECK(FixedString<16>("abc").replace("", "-") == String("abc").replace("", "-"));
+        CHECK_THROWS_AS(FixedString("abc").replace("", "-"), std::length_error);
+        CHECK(name.replace("", "x") == "xMxIxXxExDx!x");
+
+        std::vector<std::string> words { "x", "y" };
+        CHECK(FixedString("+").join<8>(words) == "x+y");
+        CHECK(StringView(name).count("I") == 1);
+    }
+}
+
+TEST_CASE("UTF-8 mode")
+{
+    SUBCASE("Validation")
+    {
+        CHECK(utf8::isvalid(""));
+        CHECK(utf8::isvalid("plain ASCII"));
+        CHECK(utf8::isvalid("gr\xc3\xbc\xc3\x9f \xe4\xb8\xad \xf0\x9f\x98\x80"));
+        CHECK(!utf8::isvalid("\x80"));
+        CHECK(!utf8::isvalid("\xc3"));
+        CHECK(!utf8::isvalid("\xc0\xaf"));
+        CHECK(!utf8::isvalid("\xe0\x80\xaf"));
+        CHECK(!utf8::isvalid("\xed\xa0\x80"));
+        CHECK(!utf8::isvalid("\xf4\x90\x80\x80"));
+        CHECK(!utf8::isvalid("\xf8\x88\x80\x80\x80"));
+        CHECK(utf8::isascii("ascii only"));
+        CHECK(!utf8::isascii("caf\xc3\xa9"));
+
+        /* Every short sequence at every offset of a block, against the
+         * byte-wise decoder */
+        const unsigned char bytes[] = { 0x00, 0x41, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc1, 0xc2, 0xdf,
+            0xe0, 0xe1, 0xec, 0xed, 0xee, 0xef, 0xf0, 0xf1, 0xf3, 0xf4, 0xf5, 0xff };
+        auto mismatches = 0;
+        for (auto a : bytes)
+            for (auto b : bytes)
+                for (auto c : bytes)
+                    for (std::size_t offset : { 0, 14, 29, 31, 40 }) {
+                        std::string text(offset, 'x');
+                        text += { static_cast<char>(a), static_cast<char>(b), static_cast<char>(c), '\x80', '\xbf' };
+                        text.resize(text.size() - (a + b) % 3);
+                        mismatches += utf8::isvalid(text) != detail::valid_utf8_scalar(text.data(), text.data() + text.size());
+                    }
+        CHECK(mismatches == 0);
+    }
+
+    SUBCASE("Code points")
+    {
+        CHECK(utf8::len("") == 0);
+        CHECK(utf8::len("hello") == 5);
+        CHECK(utf8::len("gr\xc3\xbc\xc3\x9f \xe4\xb8\xad \xf0\x9f\x98\x80") == 8);
+
+        std::string long_text;
+        for (int i = 0; i < 50; ++i)
+            long_text += "a\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80";
+        CHECK(utf8::len(long_text) == 200);
+        CHECK(String(long_text).len() == long_text.size());
+    }
+
+    SUBCASE("Case mapping")
+    {
+        String text { "Stra\xc3\x9f" "e \xc3\xa9t\xc3\xa9 \xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xce\xb1\xce\xb2\xce\xb3 \xe4\xb8\xad" };
+        CHECK(utf8::upper(text) == "STRA\xc3\x9f" "E \xc3\x89T\xc3\x89 \xd0\x9f\xd0\xa0\xd0\x98\xd0\x92\xd0\x95\xd0\xa2 \xce\x91\xce\x92\xce\x93 \xe4\xb8\xad");
+        CHECK(utf8::lower(text) == "stra\xc3\x9f" "e \xc3\xa9t\xc3\xa9 \xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xce\xb1\xce\xb2\xce\xb3 \xe4\xb8\xad");
+
+        String mixed { "\xc3\xa9" "COLE \xc3\x89" "cole" };
+        CHECK(utf8::swapcase(mixed) == "\xc3\x89" "cole \xc3\xa9" "COLE");
+        CHECK(utf8::capitalize(mixed) == "\xc3\x89" "cole \xc3\xa9" "cole");
+        CHECK(utf8::casefold(mixed) == "\xc3\xa9" "cole \xc3\xa9" "cole");
+
+        /* Mappings that are shorter in UTF-8 compact the string */
+        String shrinking { "\xc4\xb0stanbul \xe2\x84\xaa \xc5\xbfun" };
+        auto lowered = shrinking.copy();
+        CHECK(utf8::lower(lowered) == "istanbul k \xc5\xbfun");
+        CHECK(utf8::upper(shrinking) == "\xc4\xb0STANBUL \xe2\x84\xaa SUN");
+
+        String invalid { "a\xff\xc3" "b\xc3\xa9" };
+        CHECK(utf8::upper(invalid) == "A\xff\xc3" "B\xc3\x89");
+
+        String ascii { "Only ASCII here, 123!" };
+        auto upper = ascii.copy();
+        auto lower = ascii.copy();
+        CHECK(utf8::upper(upper) == ascii.copy().upper());
+        CHECK(utf8::lower(lower) == ascii.copy().lower());
+    }
+
+    SUBCASE("Case table coverage")
+    {
+        /* A letter of every block with case, from UnicodeData.txt 14.0 */
+        const std::pair<char32_t, char32_t> pairs[] = { { 0x0181, 0x0253 }, { 0x1f08, 0x1f00 }, { 0x10a0, 0x2d00 },
+            { 0x13a0, 0xab70 }, { 0x2c00, 0x2c30 }, { 0x2c80, 0x2c81 }, { 0xa640, 0xa641 }, { 0x10400, 0x10428 },
+            { 0x104b0, 0x104d8 }, { 0x10570, 0x10597 }, { 0x1e900, 0x1e922 } };
+        for (auto& pair : pairs) {
+            CHECK(detail::to_lower(pair.first) == pair.second);
+            CHECK(detail::to_upper(pair.second) == pair.first);
+        }
+        CHECK(detail::to_lower(0x01c5) == 0x01c6);
+        CHECK(detail::to_upper(0x01c5) == 0x01c4);
+        CHECK(detail::to_upper(0x10d0) == 0x1c90);
+        CHECK(detail::to_upper(0x00b5) == 0x039c);
+        CHECK(detail::to_lower(0x4e2d) == 0x4e2d);
+
+        /* U+023A lowercases to U+2C65, which is longer in UTF-8 */
+        CHECK(detail::to_lower(0x023a) == 0x023a);
+        CHECK(detail::to_upper(0x2c65) == 0x023a);
+        CHECK(detail::to_upper(0x0250) == 0x0250);
+        CHECK(detail::to_lower(0x2c6f) == 0x0250);
+
+        CHECK(detail::fold_case(0xab70) == 0x13a0);
+        CHECK(detail::fold_case(0x03c2) == 0x03c3);
+        CHECK(detail::fold_case(0x017f) == 's');
+        CHECK(detail::fold_case(0x1e9e) == 0x00df);
+        String folded { "\xcf\x82\xc3\x9f \xea\xad\xb0" };
+        CHECK(utf8::casefold(folded) == "\xcf\x83\xc3\x9f \xe1\x8e\xa0");
+
+        auto sorted = [](const auto& ranges) {
+            for (std::size_t i = 1; i < std::size(ranges); ++i)
+                if (ranges[i].first <= ranges[i - 1].last)
+                    return false;
+            return true;
+        };
+        CHECK(sorted(detail::lower_ranges));
+        CHECK(sorted(detail::upper_ranges));
+        CHECK(sorted(detail::fold_ranges));
+    }
+}
+
+TEST_CASE("String columns")
+{
+    std::vector<std::string> rows { "  apple pie ", "banana", "", "cherry apple apple", "  ", "apple", "pineapple tart" };
+    StringColumn column { rows };
+    REQUIRE(column.size() == rows.size());
+    CHECK(column[3] == "cherry apple apple");
+    CHECK(column[2].empty());
+    CHECK(column.buffer().size() == 57);
+    CHECK(column.offsets().back() == 57);
+    CHECK(String("|").join(column) == "  apple pie |banana||cherry apple apple|  |apple|pineapple tart");
+
+    SUBCASE("Predicates and counts")
+    {
+        auto selected = column.contains("apple");
+        CHECK(selected.size() == rows.size());
+        CHECK(selected.count() == 4);
+        CHECK(selected[0]);
+        CHECK(!selected[1]);
+        CHECK(column.filter(selected) == StringColumn { "  apple pie ", "cherry apple apple", "apple", "pineapple tart" });
+        CHECK(column.contains("").count() == 0);
+
+        /* Matches that span two rows do not count */
+        CHECK(column.contains("nacher").count() == 0);
+        CHECK(column.contains("eapp").count() == 1);
+        CHECK(column.contains("appleapple").count() == 0);
+        CHECK(column.contains("  apple").count() == 1);
+
+        CHECK(column.count("apple") == std::vector<StringColumn::size_type> { 1, 0, 0, 2, 0, 1, 1 });
+        CHECK(column.count("a") == std::vector<StringColumn::size_type> { 1, 3, 0, 2, 0, 1, 2 });
+        CHECK(column.count("")[1] == 7);
+
+        auto starts = column.startswith("apple");
+        CHECK(starts.count() == 1);
+        CHECK(starts[5]);
+        CHECK(column.startswith("").count() == rows.size());
+    }
+
+    SUBCASE("Batch edits")
+    {
+        CHECK(column.strip().upper() == StringColumn { "APPLE PIE", "BANANA", "", "CHERRY APPLE APPLE", "", "APPLE", "PINEAPPLE TART" });
+        CHECK(column.lower().rstrip("et") == StringColumn { "apple pi", "banana", "", "cherry apple appl", "", "appl", "pineapple tar" });
+        CHECK(column.lstrip("abnp") == StringColumn { "le pi", "", "", "cherry apple appl", "", "l", "ineapple tar" });
+
+        StringColumn words { "one two", "two", "three two two" };
+        CHECK(StringColumn(words).replace("two", "2") == StringColumn { "one 2", "2", "three 2 2" });
+        CHECK(StringColumn(words).replace("two", "TWO", 1) == StringColumn { "one TWO", "TWO", "three TWO two" });
+        CHECK(StringColumn(words).replace("o", "") == StringColumn { "ne tw", "tw", "three tw tw" });
+        CHECK(StringColumn(words).replace("", "-", 2) == StringColumn { "-o-ne two", "-t-wo", "-t-hree two two" });
+        CHECK(StringColumn(words).replace("four", "4") == words);
+        CHECK(StringColumn(words).replace("otw", "?") == words);
+    }
+
+    SUBCASE("Split")
+    {
+        auto parts = column.split();
+        REQUIRE(parts.size() == rows.size());
+        CHECK(parts.values.size() == 9);
+        CHECK(parts.offsets == std::vector<StringColumn::size_type> { 0, 2, 3, 3, 6, 6, 7, 9 });
+        CHECK(parts.values[parts.offsets[3] + 2] == "apple");
+
+        auto fields = StringColumn { "a=1", "b=2=3", "c" }.split("=", 1);
+        CHECK(fields.values == StringColumn { "a", "1", "b", "2=3", "c" });
+        CHECK(fields.offsets == std::vector<StringColumn::size_type> { 0, 2, 4, 5 });
+    }
+
+    SUBCASE("Large columns")
+    {
+        StringColumn large;
+        std::vector<std::string> reference;
+        for (int i = 0; i < 2000; ++i) {
+            reference.push_back(std::string(static_cast<std::size_t>(i % 37), 'x') + (i % 3 ? "needle" : "needl") + std::string(static_cast<std::size_t>(i % 5), ' '));
+            large.push_back(reference.back());
+        }
+
+        auto counts = large.count("needle");
+        auto found = large.contains("eedle ");
+        auto mismatches = 0;
+        for (std::size_t i = 0; i < reference.size(); ++i) {
+            mismatches += counts[i] != StringView(reference[i]).count("needle");
+            mismatches += found[i] != StringView(reference[i]).contains("eedle ");
+        }
+        CHECK(mismatches == 0);
+        CHECK(large.replace("needle", "pin").strip('x')[2] == "pin  ");
+    }
+}
+
+TEST_CASE("Search large strings on several threads")
+{
+    const auto size = 4 * Parallel::Min_search_bytes + 3;
+
+    SUBCASE("Matches across chunk boundaries")
+    {
+        String text { std::string(size, '.') };
+        for (auto pos : { std::size_t(5), size / 4 - 2, size / 2 - 1, 3 * size / 4 - 3, size - 6 })
+            std::memcpy(&text[static_cast<int>(pos)], "needle", 6);
+
+        for (unsigned threads : { 1u, 2u, 3u, 4u }) {
+            CHECK(text.count("needle", Parallel { threads }) == 5);
+            CHECK(text.find("needle", Parallel { threads }) == 5);
+            CHECK(text.rfind("needle", Parallel { threads }) == size - 6);
+            CHECK(text.contains("needle", Parallel { threads }));
+            CHECK(!text.contains("pin", Parallel { threads }));
+            CHECK(text.find("pin", Parallel { threads }) == Not_found);
+            CHECK(text.rfind("pin", Parallel { threads }) == Not_found);
+            CHECK(text.find(".n", Parallel { threads }) == 4);
+            CHECK(text.count("", Parallel { threads }) == size + 1);
+        }
+    }
+
+    SUBCASE("Self-overlapping needles are counted like the serial count")
+    {
+        const String repeated { std::string(size, 'a') };
+        CHECK(repeated.count("aa", Parallel { 4 }) == size / 2);
+        CHECK(repeated.count("aaa", Parallel { 3 }) == size / 3);
+        CHECK(repeated.rfind("aa", Parallel { 4 }) == size - 2);
+
+        const auto random = Random { 7 }.text(size, "baa");
+        const StringView view { random };
+        for (auto needle : { "aba", "abab", "aaba", "baab", "aaaa" })
+            for (unsigned threads : { 2u, 4u })
+                CHECK(view.count(needle, Parallel { threads }) == view.count(needle));
+        CHECK(view.find("bbbbbb", Parallel { 4 }) == view.find("bbbbbb"));
+        CHECK(view.rfind("bbbbbb", Parallel { 4 }) == view.rfind("bbbbbb"));
+    }
+
+    SUBCASE("Misaligned periodic text is walked once per chain")
+    {
+        /* Every chunk starts in the middle of a match of the chunk
+         * before, so each one has two chains of matches that never
+         * join */
+        const auto odd = size | 1;
+        const String repeated { std::string(odd, 'a') };
+        for (unsigned threads : { 2u, 3u, 4u, 8u })
+            CHECK(repeated.count("aa", Parallel { threads }) == odd / 2);
+        CHECK(repeated.count("aaa", Parallel { 4 }) == odd / 3);
+
+        const auto chunk = detail::count_chunk(repeated, "aa", 1, odd / 2);
+        REQUIRE(chunk.entries.size() == 2);
+        CHECK(chunk.entries[0].second.count == detail::count_matches(repeated, "aa", 1, odd / 2).count);
+        CHECK(chunk.entries[1].second.count == detail::count_matches(repeated, "aa", 2, odd / 2).count);
+        CHECK(chunk.after(0).count == chunk.entries[0].second.count);
+        CHECK(chunk.after(2).count == chunk.entries[1].second.count);
+        CHECK(chunk.searches <= odd / 2 + 4);
+
+        /* Chains that meet are walked as one */
+        std::string blocks;
+        for (std::size_t i = 0; i < Parallel::Min_search_bytes / 4; ++i)
+            blocks += "aaab";
+        const auto joined = detail::count_chunk(blocks, "aa", 0, blocks.size());
+        REQUIRE(joined.entries.size() == 2);
+        CHECK(joined.entries[0].second.count == blocks.size() / 4);
+        CHECK(joined.entries[1].second.count == blocks.size() / 4);
+        CHECK(joined.entries[1].second.last_end == blocks.size() - 2);
+        CHECK(joined.searches <= blocks.size() / 4 + 4);
+    }
+}
+
+TEST_CASE("Split lines lazily into views")
+{
+    auto collect = [](LineView range) {
+        std::vector<std::string> lines;
+        for (auto line : range)
+            lines.emplace_back(line);
+        return lines;
+    };
+
+    String text { "first\n\nthird line\nlast" };
+    CHECK(collect(text.splitlines_view()) == std::vector<std::string> { "first", "", "third line", "last" });
+    CHECK(collect(text.splitlines_view(true)) == std::vector<std::string> { "first\n", "\n", "third line\n", "last" });
+    CHECK(collect(StringView("one\n").splitlines_view()) == std::vector<std::string> { "one" });
+    CHECK(collect(StringView().splitlines_view()).empty());
+    CHECK(collect(StringView("a\r\nb\rc\vd\xe2\x80\xa8" "e").splitlines_view()) == std::vector<std::string> { "a", "b", "c", "d", "e" });
+    CHECK(collect(StringView("a\r\n\r").splitlines_view(true)) == std::vector<std::string> { "a\r\n", "\r" });
+
+    for (auto keep : { false, true }) {
+        std::vector<std::string> lines;
+        for (const auto& line : text.splitlines(keep))
+            lines.push_back(line.str);
+        CHECK(collect(text.splitlines_view(keep)) == lines);
+    }
+}
+
+#if defined(PY_STRING_POSIX)
+TEST_CASE("Memory mapped files")
+{
+    const char* path = "py_string_mapped_file.txt";
+    {
+        std::ofstream out(path, std::ios::binary);
+        for (int i = 0; i < 1000; ++i)
+            out << "line " << i << (i == 500 ? " needle" : "") << '\n';
+    }
+
+    {
+        MappedFile file(path);
+        CHECK(file.size() == 8897);
+        CHECK(file.startswith("line 0\n"));
+        CHECK(file.endswith("line 999\n"));
+        CHECK(file.count("line") == 1000);
+        CHECK(file.find("needle") == file.find("line 500") + 9);
+        CHECK(file.contains("line 42\n"));
+        CHECK(file.slice(0, 5) == "line 0");
+
+        std::size_t lines = 0;
+        for (auto line : file.splitlines_view()) {
+            CHECK(line.data() >= file.begin());
+            lines += line.startswith("line ");
+        }
+        CHECK(lines == 1000);
+
+        MappedFile moved(std::move(file));
+        CHECK(file.empty());
+        CHECK(moved.rfind("line") == moved.size() - 9);
+    }
+
+    std::ofstream(path, std::ios::trunc).close();
+    CHECK(MappedFile(std::string(path)).empty());
+    std::remove(path);
+
+    CHECK_THROWS_AS(MappedFile("py_string_missing_file.txt"), std::system_error);
+}
+#endif
+
+TEST_CASE("Read lines from streams")
+{
+    const std::string text = "one\r\ntwo\rthree\n\nfour\vfive\fsix\x1cseven\x1d" "ei\x1eght"
+                             "\xc2\x85nine\xe2\x80\xa8ten\xe2\x80\xa9" "caf\xc3\xa9 \xe2\x80\xa6\r";
+    const std::vector<std::string> lines { "one", "two", "three", "", "four", "five", "six", "seven", "ei", "ght", "nine", "ten", "caf\xc3\xa9 \xe2\x80\xa6" };
+    const std::vector<std::string> kept { "one\r\n", "two\r", "three\n", "\n", "four\v", "five\f", "six\x1c", "seven\x1d", "ei\x1e",
+        "ght\xc2\x85", "nine\xe2\x80\xa8", "ten\xe2\x80\xa9", "caf\xc3\xa9 \xe2\x80\xa6\r" };
+
+    auto read_all = [](LineReader&& reader) {
+        std::vector<std::string> result;
+        for (auto line : reader)
+            result.emplace_back(line);
+        return result;
+    };
+
+    /* Small chunks put every boundary across two reads at some point */
+    for (std::size_t chunk : { 1, 2, 3, 5, 7, 64, 4096 }) {
+        std::istringstream in(text);
+        CHECK(read_all(LineReader(in, false, chunk)) == lines);
+        std::istringstream in_kept(text);
+        CHECK(read_all(LineReader(in_kept, true, chunk)) == kept);
+    }
+
+    SUBCASE("Incomplete boundaries at the end")
+    {
+        std::istringstream partial("a\xe2\x80");
+        CHECK(read_all(LineReader(partial, false, 2)) == std::vector<std::string> { "a\xe2\x80" });
+        std::istringstream empty("");
+        CHECK(read_all(LineReader(empty)).empty());
+        std::istringstream single("\n");
+        CHECK(read_all(LineReader(single)) == std::vector<std::string> { "" });
+    }
+
+    SUBCASE("Lines longer than a chunk grow the buffer")
+    {
+        std::string long_line(10000, 'x');
+        std::istringstream in(long_line + "\nshort\n" + long_line);
+        CHECK(read_all(LineReader(in, false, 16)) == std::vector<std::string> { long_line, "short", long_line });
+    }
+
+    SUBCASE("Same lines as splitlines() and splitlines_view()")
+    {
+        std::vector<std::string> views, strings;
+        for (auto line : StringView(text).splitlines_view(true))
+            views.emplace_back(line);
+        for (const auto& line : String(text).splitlines(true))
+            strings.push_back(line.str);
+        CHECK(views == kept);
+        CHECK(strings == kept);
+    }
+
+#if defined(PY_STRING_POSIX)
+    SUBCASE("File descriptors")
+    {
+        int fds[2];
+        REQUIRE(::pipe(fds) == 0);
+        REQUIRE(::write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        ::close(fds[1]);
+        CHECK(read_all(LineReader(fds[0], false, 4)) == lines);
+        ::close(fds[0]);
+    }
+
+    SUBCASE("Short reads resume the search where it stopped")
+    {
+        /* A long line written in small pieces, with boundaries cut by
+         * the end of a piece */
+        const std::string long_line(1 << 20, 'x');
+        const std::string input = long_line + "\r\n" + long_line + "\xe2\x80\xa8" + long_line;
+        int fds[2];
+        REQUIRE(::pipe(fds) == 0);
+        std::thread writer([&] {
+            for (std::size_t pos = 0; pos < input.size(); pos += 999)
+                (void)::write(fds[1], input.data() + pos, std::min<std::size_t>(999, input.size() - pos));
+            ::close(fds[1]);
+        });
+        CHECK(read_all(LineReader(fds[0], false, 64)) == std::vector<std::string> { long_line, long_line, long_line });
+        writer.join();
+        ::close(fds[0]);
+    }
+#endif
+}
+
+TEST_CASE("Partition strings into views")
+{
+    using parts = std::vector<std::string>;
+    auto collect = [](Partition p) { return parts { std::string(p.head), std::string(p.sep), std::string(p.tail) }; };
+
+    SUBCASE("Split at the first occurrence")
+    {
+        CHECK(collect(StringView("Host: example.com:8080").partition(":")) == parts { "Host", ":", " example.com:8080" });
+        CHECK(collect(StringView("a=>b=>c").partition("=>")) == parts { "a", "=>", "b=>c" });
+        CHECK(collect(StringView("no separator").partition(":")) == parts { "no separator", "", "" });
+        CHECK(collect(StringView(":").partition(":")) == parts { "", ":", "" });
+        CHECK(collect(StringView().partition(":")) == parts { "", "", "" });
+        CHECK_THROWS_AS(StringView("abc").partition(""), std::invalid_argument);
+    }
+
+    SUBCASE("Split at the last occurrence")
+    {
+        CHECK(collect(StringView("Host: example.com:8080").rpartition(":")) == parts { "Host: example.com", ":", "8080" });
+        CHECK(collect(StringView("a=>b=>c").rpartition("=>")) == parts { "a=>b", "=>", "c" });
+        CHECK(collect(StringView("no separator").rpartition(":")) == parts { "", "", "no separator" });
+        CHECK(collect(StringView("aaa").rpartition("aa")) == parts { "a", "aa", "" });
+        CHECK_THROWS_AS(StringView("abc").rpartition(""), std::invalid_argument);
+    }
+
+    SUBCASE("Parts point into the original buffer")
+    {
+        String cookie { "session=abc=def; Path=/" };
+        auto [name, equals, value] = cookie.partition("=");
+        CHECK(name.data() == cookie.c_str());
+        CHECK(equals.data() == cookie.c_str() + 7);
+        CHECK(value == "abc=def; Path=/");
+
+        auto missing = cookie.rpartition("#");
+        CHECK(missing.head.data() == cookie.c_str());
+        CHECK(missing.tail.data() == cookie.c_str());
+    }
+
+    SUBCASE("Separators past the vector width")
+    {
+        std::string line(200, 'x');
+        line[150] = ':';
+        line[170] = ':';
+        CHECK(StringView(line).partition(":").head.size() == 150);
+        CHECK(StringView(line).rpartition(":").tail.size() == 29);
+        CHECK(StringView(line).partition("x:x").head.size() == 149);
+        CHECK(StringView(line).rpartition("x:x").head.size() == 169);
+    }
+}
+
+TEST_CASE("Allocation budgets")
+{
+    const String text { "  The quick brown fox jumps over the lazy dog, then the dog naps in the sun  " };
+    String py_str = text.copy();
+    std::vector<std::string> words { "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta" };
+
+    SUBCASE("Read-only queries never allocate")
+    {
+        std::size_t found = 0;
+        CHECK(count_allocations([&] {
+            found += text.find("dog") + text.rfind("dog") + text.count("the");
+            found += text.contains("lazy") + text.startswith("  The") + text.endswith("sun  ");
+            found += text.isalpha() + text.isspace() + text.classify();
+            found += StringView(text).slice(2, 4).size();
+            found += text.partition(",").head.size() + text.rpartition(" the ").tail.size();
+            found += text.stripped().size();
+        }) == 0);
+        CHECK(found == 42 + 56 + 4 + 3 + 3 + 45 + 5 + 73);
+    }
+
+    SUBCASE("In place edits never allocate")
+    {
+        CHECK(count_allocations([&] { py_str.strip(); }) == 0);
+        CHECK(count_allocations([&] { py_str.lstrip("Th"); }) == 0);
+        CHECK(count_allocations([&] { py_str.rstrip('n'); }) == 0);
+        CHECK(count_allocations([&] { py_str.upper().lower().swapcase().casefold().capitalize(); }) == 0);
+        CHECK(count_allocations([&] { py_str.replace("dog", "cat"); }) == 0);
+
+        auto table = String::maketrans("abc", "xyz", "!");
+        CHECK(count_allocations([&] { py_str.translate(table); }) == 0);
+        CHECK(count_allocations([&] { py_str.del(0); }) == 0);
+        CHECK(py_str == " quizk yrown fox jumps over the lxzy zxt, then the zxt nxps in the su");
+    }
+
+    SUBCASE("Lazy ranges never allocate")
+    {
+        std::size_t tokens = 0;
+        CHECK(count_allocations([&] {
+            for (auto token : text.split_view())
+                tokens += !token.empty();
+            for (auto token : text.split_view(","))
+                tokens += !token.empty();
+        }) == 0);
+        CHECK(tokens == 18);
+    }
+
+    SUBCASE("Building a new string allocates at most once")
+    {
+        CHECK(count_allocations([&] { String(", ").join(words); }) <= 1);
+        CHECK(count_allocations([&] { String("-").join(text); }) <= 1);
+        CHECK(count_allocations([&] { py_str.replace("the", "a"); }) <= 1);
+        CHECK(count_allocations([&] { py_str.replace("", "|", 8); }) <= 1);
+        CHECK(count_allocations([&] { text.copy(); }) <= 1);
+        CHECK(count_allocations([&] { text.slice(2, -3); }) <= 1);
+        CHECK(count_allocations([&] { String joined = text + ' ' + text + ',' + py_str; }) <= 1);
+        CHECK(count_allocations([&] { py_str.zfill(200); }) <= 1);
+        CHECK(count_allocations([&] { py_str::format_to(py_str, "{} {:>8} {:.3f}", "cpu", 42, 3.14159); }) <= 1);
+    }
+
+    SUBCASE("Splitting allocates once per token plus the vector growth")
+    {
+        auto tokens = text.split();
+        auto allocations = count_allocations([&] { text.split(); });
+        CHECK(allocations.count <= tokens.size() + 5);
+
+        Arena arena;
+        ArenaString arena_str { text.c_str(), ArenaAllocator<char> { arena } };
+        CHECK(count_allocations([&] { arena_str.split(); }) <= 1);
+    }
+
+    SUBCASE("Splitting into a reused container of views never allocates")
+    {
+        std::vector<StringView> tokens;
+        text.split_to(tokens);
+        auto allocations = count_allocations([&] {
+            text.split_to(tokens);
+            text.rsplit_to(tokens, 3);
+            text.split_to(tokens, " ", 4);
+            text.rsplit_to(tokens, "the");
+        });
+        CHECK(allocations == 0);
+        CHECK(tokens.size() == 5);
+    }
+}
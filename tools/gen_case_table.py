@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Regenerates the Unicode case tables of py_string.h.
+
+Usage: gen_case_table.py UnicodeData.txt CaseFolding.txt py_string.h
+
+Reads the simple uppercase and lowercase mappings (fields 12 and 13) of
+UnicodeData.txt and the simple case folding (status C and S) of
+CaseFolding.txt, and replaces the lines between the BEGIN and END case
+table markers of py_string.h. Mappings whose result is longer in UTF-8
+than the source are left out, so that case mapping can be done in
+place. Mappings between two ASCII characters are handled by the ASCII
+kernels and left out too.
+"""
+
+import sys
+
+BEGIN = "/* BEGIN case tables, generated by tools/gen_case_table.py */\n"
+END = "/* END case tables */\n"
+
+
+def utf8_length(code_point):
+    return 1 if code_point < 0x80 else 2 if code_point < 0x800 else 3 if code_point < 0x10000 else 4
+
+
+def read_unicode_data(path):
+    lower, upper = {}, {}
+    with open(path) as data:
+        for line in data:
+            fields = line.rstrip("\n").split(";")
+            if len(fields) < 14:
+                continue
+            code_point = int(fields[0], 16)
+            if fields[12]:
+                upper[code_point] = int(fields[12], 16)
+            if fields[13]:
+                lower[code_point] = int(fields[13], 16)
+    return lower, upper
+
+
+def read_case_folding(path):
+    fold = {}
+    with open(path) as data:
+        for line in data:
+            line = line.split("#")[0].strip()
+            if not line:
+                continue
+            code, status, mapping = (field.strip() for field in line.split(";")[:3])
+            if status in ("C", "S"):
+                fold[int(code, 16)] = int(mapping, 16)
+    return fold
+
+
+def ranges(mapping):
+    """Merges the mapping into ranges of sources first, first + step, ...,
+    last that all map by adding the same delta. The ranges are sorted and
+    do not overlap, so they can be binary searched."""
+    pairs = sorted(
+        (source, target)
+        for source, target in mapping.items()
+        if source != target
+        and (source >= 0x80 or target >= 0x80)
+        and utf8_length(target) <= utf8_length(source)
+    )
+
+    result = []
+    for source, target in pairs:
+        delta = target - source
+        if result:
+            first, last, last_delta, step = result[-1]
+            if last_delta == delta:
+                if step == 0 and source - last < 256:
+                    result[-1] = (first, source, delta, source - last)
+                    continue
+                if step and source == last + step:
+                    result[-1] = (first, source, delta, step)
+                    continue
+        result.append((source, source, delta, 0))
+
+    return [(first, last, delta, step or 1) for first, last, delta, step in result]
+
+
+def table(name, mapping):
+    lines = ["inline constexpr Case_range %s[] = {\n" % name]
+    for first, last, delta, step in ranges(mapping):
+        lines.append("    { 0x%04x, 0x%04x, %d, %d },\n" % (first, last, delta, step))
+    lines.append("};\n")
+    return lines
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__.strip().splitlines()[2])
+
+    lower, upper = read_unicode_data(sys.argv[1])
+    fold = read_case_folding(sys.argv[2])
+
+    with open(sys.argv[3]) as header:
+        lines = header.readlines()
+    begin = lines.index(BEGIN)
+    end = lines.index(END)
+
+    generated = table("lower_ranges", lower) + ["\n"] + table("upper_ranges", upper) + ["\n"] + table("fold_ranges", fold)
+    lines[begin + 1 : end] = generated
+
+    with open(sys.argv[3], "w") as header:
+        header.writelines(lines)
+
+
+if __name__ == "__main__":
+    main()